@@ -0,0 +1,433 @@
+#include "atlaspacker.h"
+#include <iostream>
+#include <cstdlib>
+#include <algorithm>
+
+#define UNLIMITED_HEIGHT 0x7fffffffu
+
+namespace
+{
+
+class ShelfPacker final : public AtlasPacker
+{
+public:
+    ShelfPacker(unsigned int width, unsigned int maxHeight)
+        :AtlasPacker(width, maxHeight)
+        ,m_lineWidth(0)
+        ,m_lineY(0)
+        ,m_maxLineHeight(0)
+    {
+
+    }
+
+    bool insert(unsigned int width, unsigned int height, unsigned int& x, unsigned int& y) override
+    {
+        if(width > m_width)
+        {
+            return false;
+        }
+        unsigned int lineWidth = m_lineWidth;
+        unsigned int lineY = m_lineY;
+        unsigned int maxLineHeight = m_maxLineHeight;
+        if(lineWidth + width > m_width)
+        {
+            lineWidth = 0;
+            lineY += maxLineHeight;
+            maxLineHeight = 0;
+        }
+        if(lineY + height > m_maxHeight)
+        {
+            return false;
+        }
+        x = lineWidth;
+        y = lineY;
+        m_lineWidth = lineWidth + width;
+        m_lineY = lineY;
+        m_maxLineHeight = std::max(maxLineHeight, height);
+        placed(x, y, width, height);
+        m_usedHeight = std::max(m_usedHeight, m_lineY + m_maxLineHeight);
+        return true;
+    }
+
+private:
+    unsigned int m_lineWidth;
+    unsigned int m_lineY;
+    unsigned int m_maxLineHeight;
+};
+
+class SkylinePacker final : public AtlasPacker
+{
+public:
+    SkylinePacker(unsigned int width, unsigned int maxHeight)
+        :AtlasPacker(width, maxHeight)
+    {
+        m_skyline.push_back(Node{0, 0, width});
+    }
+
+    bool insert(unsigned int width, unsigned int height, unsigned int& x, unsigned int& y) override
+    {
+        if(width == 0 || height == 0)
+        {
+            x = 0;
+            y = 0;
+            return true;
+        }
+        size_t bestIndex = m_skyline.size();
+        unsigned int bestBottom = 0;
+        unsigned int bestWidth = 0;
+        unsigned int bestY = 0;
+        for(size_t i = 0; i < m_skyline.size(); i++)
+        {
+            unsigned int tmpY;
+            if(fit(i, width, height, tmpY))
+            {
+                unsigned int bottom = tmpY + height;
+                if(bestIndex == m_skyline.size() || bottom < bestBottom || (bottom == bestBottom && m_skyline[i].width < bestWidth))
+                {
+                    bestIndex = i;
+                    bestBottom = bottom;
+                    bestWidth = m_skyline[i].width;
+                    bestY = tmpY;
+                }
+            }
+        }
+        if(bestIndex == m_skyline.size())
+        {
+            return false;
+        }
+        x = m_skyline[bestIndex].x;
+        y = bestY;
+        addLevel(bestIndex, x, y, width, height);
+        placed(x, y, width, height);
+        return true;
+    }
+
+private:
+    struct Node
+    {
+        unsigned int x;
+        unsigned int y;
+        unsigned int width;
+    };
+
+    bool fit(size_t index, unsigned int width, unsigned int height, unsigned int& y) const
+    {
+        unsigned int x = m_skyline[index].x;
+        if(x + width > m_width)
+        {
+            return false;
+        }
+        y = 0;
+        unsigned int covered = 0;
+        for(size_t i = index; covered < width; i++)
+        {
+            y = std::max(y, m_skyline[i].y);
+            if(y + height > m_maxHeight)
+            {
+                return false;
+            }
+            covered += m_skyline[i].width;
+        }
+        return true;
+    }
+
+    void addLevel(size_t index, unsigned int x, unsigned int y, unsigned int width, unsigned int height)
+    {
+        m_skyline.insert(m_skyline.begin() + index, Node{x, y + height, width});
+        for(size_t i = index + 1; i < m_skyline.size(); )
+        {
+            unsigned int prevRight = m_skyline[i-1].x + m_skyline[i-1].width;
+            if(m_skyline[i].x >= prevRight)
+            {
+                break;
+            }
+            unsigned int shrink = prevRight - m_skyline[i].x;
+            if(m_skyline[i].width <= shrink)
+            {
+                m_skyline.erase(m_skyline.begin() + i);
+            }
+            else
+            {
+                m_skyline[i].x += shrink;
+                m_skyline[i].width -= shrink;
+                break;
+            }
+        }
+        for(size_t i = 0; i + 1 < m_skyline.size(); )
+        {
+            if(m_skyline[i].y == m_skyline[i+1].y)
+            {
+                m_skyline[i].width += m_skyline[i+1].width;
+                m_skyline.erase(m_skyline.begin() + i + 1);
+            }
+            else
+            {
+                i++;
+            }
+        }
+    }
+
+    std::vector<Node> m_skyline;
+};
+
+class MaxRectsPacker final : public AtlasPacker
+{
+public:
+    MaxRectsPacker(unsigned int width, unsigned int maxHeight)
+        :AtlasPacker(width, maxHeight)
+    {
+        m_freeRects.push_back(Rect{0, 0, width, m_maxHeight});
+    }
+
+    bool insert(unsigned int width, unsigned int height, unsigned int& x, unsigned int& y) override
+    {
+        if(width == 0 || height == 0)
+        {
+            x = 0;
+            y = 0;
+            return true;
+        }
+        //nothing that is still to come fits into slivers below the minimum size, drop them for good
+        unsigned int minWidth = m_minWidth;
+        unsigned int minHeight = m_minHeight;
+        m_freeRects.erase(std::remove_if(m_freeRects.begin(), m_freeRects.end(), [minWidth, minHeight](const Rect& r) {
+            return r.width < minWidth || r.height < minHeight;
+        }), m_freeRects.end());
+
+        size_t bestIndex = m_freeRects.size();
+        for(size_t i = 0; i < m_freeRects.size(); i++)
+        {
+            const Rect& r = m_freeRects[i];
+            if(r.width >= width && r.height >= height)
+            {
+                if(bestIndex == m_freeRects.size()
+                        || r.y < m_freeRects[bestIndex].y
+                        || (r.y == m_freeRects[bestIndex].y && r.x < m_freeRects[bestIndex].x))
+                {
+                    bestIndex = i;
+                }
+            }
+        }
+        if(bestIndex == m_freeRects.size())
+        {
+            return false;
+        }
+        x = m_freeRects[bestIndex].x;
+        y = m_freeRects[bestIndex].y;
+        split(Rect{x, y, width, height});
+        placed(x, y, width, height);
+        return true;
+    }
+
+private:
+    struct Rect
+    {
+        unsigned int x;
+        unsigned int y;
+        unsigned int width;
+        unsigned int height;
+    };
+
+    static bool contains(const Rect& a, const Rect& b)
+    {
+        return b.x >= a.x && b.y >= a.y && b.x + b.width <= a.x + a.width && b.y + b.height <= a.y + a.height;
+    }
+
+    void split(const Rect& used)
+    {
+        std::vector<Rect> newRects;
+        for(size_t i = 0; i < m_freeRects.size(); )
+        {
+            Rect r = m_freeRects[i];
+            if(used.x >= r.x + r.width || used.x + used.width <= r.x || used.y >= r.y + r.height || used.y + used.height <= r.y)
+            {
+                i++;
+                continue;
+            }
+            if(used.x > r.x)
+            {
+                newRects.push_back(Rect{r.x, r.y, used.x - r.x, r.height});
+            }
+            if(used.x + used.width < r.x + r.width)
+            {
+                newRects.push_back(Rect{used.x + used.width, r.y, r.x + r.width - used.x - used.width, r.height});
+            }
+            if(used.y > r.y)
+            {
+                newRects.push_back(Rect{r.x, r.y, r.width, used.y - r.y});
+            }
+            if(used.y + used.height < r.y + r.height)
+            {
+                newRects.push_back(Rect{r.x, used.y + used.height, r.width, r.y + r.height - used.y - used.height});
+            }
+            m_freeRects[i] = m_freeRects.back();
+            m_freeRects.pop_back();
+        }
+
+        //pieces are only checked against their siblings, checking them against every old
+        //free rectangle as well is quadratic and hardly removes anything
+        for(size_t i = 0; i < newRects.size(); i++)
+        {
+            bool redundant = false;
+            for(size_t j = 0; j < newRects.size() && !redundant; j++)
+            {
+                if(j != i && contains(newRects[j], newRects[i]))
+                {
+                    //of two identical pieces keep the first one
+                    redundant = !contains(newRects[i], newRects[j]) || j < i;
+                }
+            }
+            if(!redundant)
+            {
+                m_freeRects.push_back(newRects[i]);
+            }
+        }
+    }
+
+    std::vector<Rect> m_freeRects;
+};
+
+}
+
+AtlasPacker::AtlasPacker(unsigned int width, unsigned int maxHeight)
+    :m_width(width)
+    ,m_maxHeight(maxHeight == 0 ? UNLIMITED_HEIGHT : maxHeight)
+    ,m_usedHeight(0)
+    ,m_usedPixels(0)
+    ,m_minWidth(0)
+    ,m_minHeight(0)
+{
+
+}
+
+AtlasPacker::~AtlasPacker()
+{
+
+}
+
+std::unique_ptr<AtlasPacker> AtlasPacker::create(PackingStrategy strategy, unsigned int width, unsigned int maxHeight)
+{
+    switch(strategy)
+    {
+    case PackingStrategy::Skyline:
+        return std::unique_ptr<AtlasPacker>(new SkylinePacker(width, maxHeight));
+    case PackingStrategy::MaxRects:
+        return std::unique_ptr<AtlasPacker>(new MaxRectsPacker(width, maxHeight));
+    case PackingStrategy::Shelf:
+    default:
+        return std::unique_ptr<AtlasPacker>(new ShelfPacker(width, maxHeight));
+    }
+}
+
+void AtlasPacker::setMinimumSize(unsigned int width, unsigned int height)
+{
+    m_minWidth = width;
+    m_minHeight = height;
+}
+
+unsigned int AtlasPacker::width() const
+{
+    return m_width;
+}
+
+unsigned int AtlasPacker::maxHeight() const
+{
+    return m_maxHeight;
+}
+
+unsigned int AtlasPacker::usedHeight() const
+{
+    return m_usedHeight;
+}
+
+unsigned long long AtlasPacker::usedPixels() const
+{
+    return m_usedPixels;
+}
+
+void AtlasPacker::placed(unsigned int x, unsigned int y, unsigned int width, unsigned int height)
+{
+    (void)x;
+    m_usedHeight = std::max(m_usedHeight, y + height);
+    m_usedPixels += (unsigned long long)width * height;
+}
+
+const char* packingStrategyName(PackingStrategy strategy)
+{
+    switch(strategy)
+    {
+    case PackingStrategy::Shelf:
+        return "shelf";
+    case PackingStrategy::Skyline:
+        return "skyline";
+    case PackingStrategy::MaxRects:
+        return "maxrects";
+    default:
+        return "unknown";
+    }
+}
+
+PackingReport packRects(std::vector<PackRect>& rects, PackingStrategy strategy, bool sortByHeight, unsigned int width, unsigned int maxHeight)
+{
+    std::vector<size_t> order(rects.size());
+    for(size_t i = 0; i < order.size(); i++)
+    {
+        order[i] = i;
+    }
+    if(sortByHeight)
+    {
+        std::stable_sort(order.begin(), order.end(), [&rects](size_t a, size_t b) {
+            if(rects[a].height != rects[b].height)
+            {
+                return rects[a].height > rects[b].height;
+            }
+            return rects[a].width > rects[b].width;
+        });
+    }
+
+    //smallest width and height among the rectangles that are still to be inserted
+    std::vector<PackRect> remainingMin(order.size() + 1, PackRect{~0u, ~0u, 0, 0, 0});
+    for(size_t i = order.size(); i > 0; i--)
+    {
+        const PackRect& rect = rects[order[i-1]];
+        remainingMin[i-1] = remainingMin[i];
+        if(rect.width != 0 && rect.height != 0)
+        {
+            remainingMin[i-1].width = std::min(remainingMin[i].width, rect.width);
+            remainingMin[i-1].height = std::min(remainingMin[i].height, rect.height);
+        }
+    }
+
+    std::vector<std::unique_ptr<AtlasPacker> > pages;
+    pages.push_back(AtlasPacker::create(strategy, width, maxHeight));
+    for(size_t i = 0; i < order.size(); i++)
+    {
+        PackRect& rect = rects[order[i]];
+        pages.back()->setMinimumSize(remainingMin[i].width, remainingMin[i].height);
+        if(!pages.back()->insert(rect.width, rect.height, rect.x, rect.y))
+        {
+            pages.push_back(AtlasPacker::create(strategy, width, maxHeight));
+            pages.back()->setMinimumSize(remainingMin[i].width, remainingMin[i].height);
+            if(!pages.back()->insert(rect.width, rect.height, rect.x, rect.y))
+            {
+                std::cerr << "[Error] " << __FILE__ << ": Line " << __LINE__ << " a " << rect.width << "x" << rect.height << " rectangle doesn't fit into a " << width << "x" << maxHeight << " atlas page" << std::endl;
+                exit(1);
+            }
+        }
+        rect.page = pages.size() - 1;
+    }
+
+    PackingReport report;
+    report.strategy = strategy;
+    report.sortByHeight = sortByHeight;
+    report.textureWidth = width;
+    report.textureHeight = pages.size() == 1 ? pages.back()->usedHeight() : pages.back()->maxHeight();
+    report.pageNum = pages.size();
+    report.usedPixels = 0;
+    for(auto iter = pages.begin(); iter != pages.end(); iter++)
+    {
+        report.usedPixels += (*iter)->usedPixels();
+    }
+    report.occupancy = report.textureHeight == 0 ? 0.0f : (float)(100.0 * report.usedPixels / ((double)width * report.textureHeight * report.pageNum));
+    return report;
+}
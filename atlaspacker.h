@@ -0,0 +1,75 @@
+#ifndef ATLASPACKER_H
+#define ATLASPACKER_H
+
+#include <memory>
+#include <vector>
+
+enum class PackingStrategy
+{
+    Shelf,      //rows advance by the tallest glyph of the row
+    Skyline,    //skyline bottom-left
+    MaxRects    //maximal free rectangles, bottom-left rule
+};
+
+struct PackRect
+{
+    unsigned int width;
+    unsigned int height;
+    unsigned int x;
+    unsigned int y;
+    unsigned int page;
+};
+
+struct PackingReport
+{
+    PackingStrategy strategy;
+    bool sortByHeight;
+    unsigned int textureWidth;   //in pixel
+    unsigned int textureHeight;  //in pixel, of every page
+    unsigned int pageNum;
+    unsigned long long usedPixels;
+    float occupancy;  //usedPixels in percent of textureWidth * textureHeight * pageNum
+};
+
+class AtlasPacker
+{
+public:
+    //maxHeight 0 means the atlas may grow downwards without limit
+    static std::unique_ptr<AtlasPacker> create(PackingStrategy strategy, unsigned int width, unsigned int maxHeight);
+    virtual ~AtlasPacker();
+
+    //returns false if the rectangle doesn't fit any more
+    virtual bool insert(unsigned int width, unsigned int height, unsigned int& x, unsigned int& y) = 0;
+    //promise that no rectangle smaller than this in either direction will be inserted any more
+    void setMinimumSize(unsigned int width, unsigned int height);
+
+    unsigned int width() const;
+    unsigned int maxHeight() const;
+    unsigned int usedHeight() const;
+    unsigned long long usedPixels() const;
+
+protected:
+    AtlasPacker(unsigned int width, unsigned int maxHeight);
+    void placed(unsigned int x, unsigned int y, unsigned int width, unsigned int height);
+
+    unsigned int m_width;
+    unsigned int m_maxHeight;
+    unsigned int m_usedHeight;
+    unsigned long long m_usedPixels;
+    unsigned int m_minWidth;
+    unsigned int m_minHeight;
+
+private:
+    AtlasPacker& operator=(const AtlasPacker&) = delete;
+    AtlasPacker(const AtlasPacker&) = delete;
+};
+
+const char* packingStrategyName(PackingStrategy strategy);
+
+//places every rectangle of rects into width wide atlas pages and fills in x/y/page,
+//sortByHeight inserts the rectangles tallest first but keeps their order in rects.
+//A new page is started whenever a rectangle doesn't fit below maxHeight (0 means a single
+//page of unlimited height); with more than one page every page is maxHeight high
+PackingReport packRects(std::vector<PackRect>& rects, PackingStrategy strategy, bool sortByHeight, unsigned int width, unsigned int maxHeight = 0);
+
+#endif // ATLASPACKER_H
@@ -0,0 +1,231 @@
+#include "atlasuploader.h"
+#include "glcheck.h"
+#include <cstring>
+#include <algorithm>
+
+AtlasTextureFormat atlasTextureFormat(AtlasFormat format)
+{
+    switch(format)
+    {
+    case AtlasFormat::Coverage4:
+        return AtlasTextureFormat{GL_R8, GL_RED, 2, 1};
+    case AtlasFormat::LCD:
+        return AtlasTextureFormat{GL_RGB8, GL_RGB, 1, 3};
+    default:
+        return AtlasTextureFormat{GL_R8, GL_RED, 1, 1};
+    }
+}
+
+AtlasUploader::AtlasUploader(size_t bufferSize, unsigned int bufferNum)
+    :m_bufferSize(bufferSize)
+    ,m_buffers(std::max(1u, bufferNum), 0)
+    ,m_fences(m_buffers.size(), nullptr)
+    ,m_nextBuffer(0)
+    ,m_pendingByteNum(0)
+    ,m_busyBufferNum(0)
+    ,m_textureFormat(atlasTextureFormat(AtlasFormat::Coverage8))
+    ,m_compressed(false)
+{
+}
+
+AtlasUploader::~AtlasUploader()
+{
+    for(size_t i = 0; i < m_fences.size(); i++)
+    {
+        if(m_fences[i])
+        {
+            glDeleteSync(m_fences[i]);
+        }
+    }
+    if(m_buffers[0])
+    {
+        glDeleteBuffers(m_buffers.size(), m_buffers.data());
+    }
+}
+
+void AtlasUploader::initializeGL()
+{
+    initializeOpenGLFunctions();
+    CHECK_OPENGL_ES_ERROR(glGenBuffers(m_buffers.size(), m_buffers.data()));
+    for(size_t i = 0; i < m_buffers.size(); i++)
+    {
+        CHECK_OPENGL_ES_ERROR(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffers[i]));
+        CHECK_OPENGL_ES_ERROR(glBufferData(GL_PIXEL_UNPACK_BUFFER, m_bufferSize, nullptr, GL_STREAM_DRAW));
+    }
+    CHECK_OPENGL_ES_ERROR(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+}
+
+void AtlasUploader::allocate(const TextureFont* font, GLuint texture)
+{
+    m_textureFormat = atlasTextureFormat(font->atlasFormat());
+    unsigned int texelWidth = (font->textureWidth() + m_textureFormat.pixelsPerTexel - 1) / m_textureFormat.pixelsPerTexel;
+    m_compressed = font->eacTexture() != nullptr;
+    CHECK_OPENGL_ES_ERROR(glBindTexture(GL_TEXTURE_2D_ARRAY, texture));
+    if(m_compressed)
+    {
+        CHECK_OPENGL_ES_ERROR(glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_COMPRESSED_R11_EAC, font->textureWidth(), font->textureHeight(), font->pageNum(), 0,
+                                                     font->eacPageBytes() * font->pageNum(), font->eacTexture()));
+        return;
+    }
+    CHECK_OPENGL_ES_ERROR(glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, m_textureFormat.internalFormat, texelWidth, font->textureHeight(), font->pageNum(), 0,
+                                       m_textureFormat.format, GL_UNSIGNED_BYTE, nullptr));
+}
+
+void AtlasUploader::enqueue(const DirtyRect& rect)
+{
+    if(m_compressed || rect.width == 0 || rect.height == 0)
+    {
+        return;
+    }
+    m_queue.push_back(rect);
+    m_pendingByteNum += rowByteNum(rect) * rect.height;
+}
+
+void AtlasUploader::enqueue(const std::vector<DirtyRect>& rects)
+{
+    for(auto iter = rects.begin(); iter != rects.end(); iter++)
+    {
+        enqueue(*iter);
+    }
+}
+
+void AtlasUploader::enqueuePages(const TextureFont* font)
+{
+    for(unsigned int page = 0; page < font->pageNum(); page++)
+    {
+        enqueue(DirtyRect{page, 0, 0, font->textureWidth(), font->textureHeight()});
+    }
+}
+
+void AtlasUploader::clear()
+{
+    m_queue.clear();
+    m_pendingByteNum = 0;
+}
+
+size_t AtlasUploader::upload(const TextureFont* font, GLuint texture, size_t maxByteNum)
+{
+    size_t byteNum = 0;
+    size_t textureRowBytes = font->textureRowBytes();
+    if(textureRowBytes > m_bufferSize)
+    {
+        qDebug() << QString("[Error] %1, Line %2: a %3 byte pixel buffer can't hold a row of the %4 pixel wide atlas").arg(__FILE__).arg(__LINE__).arg(m_bufferSize).arg(font->textureWidth());
+        exit(1);
+    }
+    CHECK_OPENGL_ES_ERROR(glBindTexture(GL_TEXTURE_2D_ARRAY, texture));
+    CHECK_OPENGL_ES_ERROR(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+    //at most one pass around the ring, a buffer the GPU still reads ends the frame's upload
+    for(size_t pass = 0; pass < m_buffers.size() && !m_queue.empty() && byteNum < maxByteNum; pass++)
+    {
+        if(!bufferFree(m_nextBuffer))
+        {
+            break;
+        }
+        CHECK_OPENGL_ES_ERROR(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffers[m_nextBuffer]));
+        //the fence passed, nothing reads the buffer any more
+        unsigned char* mapped = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, m_bufferSize,
+                                                                              GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+        if(!mapped)
+        {
+            qDebug() << QString("[Error] %1, Line %2: glMapBufferRange failed").arg(__FILE__).arg(__LINE__);
+            exit(1);
+        }
+
+        //whole rows of the queued regions, packed tightly one after another
+        size_t offset = 0;
+        m_tileCopies.clear();
+        while(!m_queue.empty() && byteNum < maxByteNum)
+        {
+            DirtyRect& rect = m_queue.front();
+            unsigned int firstTexel;
+            unsigned int endTexel;
+            texelColumns(rect, firstTexel, endTexel);
+            size_t rowBytes = (size_t)(endTexel - firstTexel) * m_textureFormat.bytesPerTexel;
+            size_t rowNum = std::min((size_t)rect.height, (m_bufferSize - offset) / rowBytes);
+            rowNum = std::min(rowNum, std::max((size_t)1, (maxByteNum - byteNum) / rowBytes));
+            if(rowNum == 0)
+            {
+                break;
+            }
+            const unsigned char* source = font->texture(rect.page) + (size_t)rect.y * textureRowBytes + (size_t)firstTexel * m_textureFormat.bytesPerTexel;
+            for(size_t j = 0; j < rowNum; j++)
+            {
+                memcpy(mapped + offset + j * rowBytes, source + j * textureRowBytes, rowBytes);
+            }
+            m_tileCopies.push_back(TileCopy{rect.page, firstTexel, rect.y, endTexel - firstTexel, (unsigned int)rowNum, offset});
+            size_t size = rowNum * rowBytes;
+            offset += size;
+            byteNum += size;
+            m_pendingByteNum -= size;
+            rect.y += rowNum;
+            rect.height -= rowNum;
+            if(rect.height == 0)
+            {
+                m_queue.pop_front();
+            }
+        }
+        CHECK_OPENGL_ES_ERROR(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER));
+
+        for(auto iter = m_tileCopies.begin(); iter != m_tileCopies.end(); iter++)
+        {
+            CHECK_OPENGL_ES_ERROR(glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, iter->x, iter->y, iter->page, iter->width, iter->height, 1,
+                                                  m_textureFormat.format, GL_UNSIGNED_BYTE, (const void *)iter->offset));
+        }
+        m_fences[m_nextBuffer] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        m_nextBuffer = (m_nextBuffer + 1) % m_buffers.size();
+    }
+    CHECK_OPENGL_ES_ERROR(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+
+    m_busyBufferNum = 0;
+    for(size_t i = 0; i < m_fences.size(); i++)
+    {
+        GLint status = GL_SIGNALED;
+        if(m_fences[i])
+        {
+            glGetSynciv(m_fences[i], GL_SYNC_STATUS, 1, nullptr, &status);
+        }
+        m_busyBufferNum += status != GL_SIGNALED;
+    }
+    return byteNum;
+}
+
+size_t AtlasUploader::pendingByteNum() const
+{
+    return m_pendingByteNum;
+}
+
+unsigned int AtlasUploader::busyBufferNum() const
+{
+    return m_busyBufferNum;
+}
+
+void AtlasUploader::texelColumns(const DirtyRect& rect, unsigned int& first, unsigned int& end) const
+{
+    first = rect.x / m_textureFormat.pixelsPerTexel;
+    end = (rect.x + rect.width + m_textureFormat.pixelsPerTexel - 1) / m_textureFormat.pixelsPerTexel;
+}
+
+size_t AtlasUploader::rowByteNum(const DirtyRect& rect) const
+{
+    unsigned int first;
+    unsigned int end;
+    texelColumns(rect, first, end);
+    return (size_t)(end - first) * m_textureFormat.bytesPerTexel;
+}
+
+bool AtlasUploader::bufferFree(unsigned int buffer)
+{
+    if(!m_fences[buffer])
+    {
+        return true;
+    }
+    //a zero timeout only polls, the flush makes sure the fence gets signalled at all
+    GLenum status = glClientWaitSync(m_fences[buffer], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if(status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED)
+    {
+        return false;
+    }
+    glDeleteSync(m_fences[buffer]);
+    m_fences[buffer] = nullptr;
+    return true;
+}
@@ -0,0 +1,78 @@
+#ifndef ATLASUPLOADER_H
+#define ATLASUPLOADER_H
+
+#include <QOpenGLExtraFunctions>
+#include <deque>
+#include <vector>
+#include "texturefont.h"
+
+//how the atlas of a format is laid out in a GL texture: coverage8 is GL_R8, coverage4 is GL_R8 at half
+//the width with two pixels per texel that the shader unpacks, LCD is GL_RGB8
+struct AtlasTextureFormat
+{
+    GLenum internalFormat;
+    GLenum format;
+    unsigned int pixelsPerTexel;
+    unsigned int bytesPerTexel;
+};
+
+AtlasTextureFormat atlasTextureFormat(AtlasFormat format);
+
+//streams regions of a TextureFont into its array texture through a ring of pixel unpack
+//buffers: every upload() copies queued rows into the buffers the GPU is done with and issues
+//glTexSubImage3D from them, a fence per buffer tells when it may be written again. Neither side
+//waits on the other, regions that don't fit the budget or the free buffers wait for the next frame.
+//A font with an EAC texture is uploaded whole by allocate() and queues nothing
+class AtlasUploader final : protected QOpenGLExtraFunctions
+{
+public:
+    //bufferSize in byte, at least one row of the widest page
+    explicit AtlasUploader(size_t bufferSize = 4 * 1024 * 1024, unsigned int bufferNum = 3);
+    ~AtlasUploader();  //the context of initializeGL() has to be current
+
+    void initializeGL();
+    //(re)allocates texture for every page of font and remembers the layout of its format for the
+    //regions queued after, or fills it from font->eacTexture(); leaves texture bound to GL_TEXTURE_2D_ARRAY
+    void allocate(const TextureFont* font, GLuint texture);
+    void enqueue(const DirtyRect& rect);
+    void enqueue(const std::vector<DirtyRect>& rects);
+    void enqueuePages(const TextureFont* font);  //every page, after the texture was reallocated
+    void clear();  //drops the queued regions
+    //uploads at most maxByteNum of the queued regions from the current pixels of font into texture
+    //and returns the bytes uploaded; leaves GL_PIXEL_UNPACK_BUFFER unbound
+    size_t upload(const TextureFont* font, GLuint texture, size_t maxByteNum);
+    size_t pendingByteNum() const;
+    unsigned int busyBufferNum() const;  //of the last upload(), still read by the GPU
+
+private:
+    AtlasUploader& operator=(const AtlasUploader&) = delete;
+    AtlasUploader(const AtlasUploader&) = delete;
+
+    struct TileCopy
+    {
+        unsigned int page;
+        unsigned int x;  //in texels
+        unsigned int y;
+        unsigned int width;  //in texels
+        unsigned int height;
+        size_t offset;  //in the buffer
+    };
+
+    bool bufferFree(unsigned int buffer);
+    void texelColumns(const DirtyRect& rect, unsigned int& first, unsigned int& end) const;  //covering the pixels of rect
+    size_t rowByteNum(const DirtyRect& rect) const;
+
+private:
+    size_t m_bufferSize;
+    std::vector<GLuint> m_buffers;
+    std::vector<GLsync> m_fences;  //nullptr when the buffer is free
+    unsigned int m_nextBuffer;
+    std::deque<DirtyRect> m_queue;  //rows already uploaded are cut off the front region
+    size_t m_pendingByteNum;
+    unsigned int m_busyBufferNum;
+    std::vector<TileCopy> m_tileCopies;
+    AtlasTextureFormat m_textureFormat;
+    bool m_compressed;  //the texture holds the EAC blocks of a static atlas
+};
+
+#endif // ATLASUPLOADER_H
@@ -0,0 +1,328 @@
+#include "characterset.h"
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#define MAX_UNICODE 0x10ffffu
+#define INVALID_UNICODE 0xffffffffu
+
+namespace
+{
+
+//returns INVALID_UNICODE for a malformed or overlong sequence and skips its first byte only
+unsigned int decodeUtf8(const unsigned char*& text, const unsigned char* end)
+{
+    unsigned int lead = *text++;
+    if(lead < 0x80)
+    {
+        return lead;
+    }
+    size_t length;
+    unsigned int unicode;
+    unsigned int minimum;
+    if((lead & 0xe0) == 0xc0)
+    {
+        length = 1;
+        unicode = lead & 0x1f;
+        minimum = 0x80;
+    }
+    else if((lead & 0xf0) == 0xe0)
+    {
+        length = 2;
+        unicode = lead & 0x0f;
+        minimum = 0x800;
+    }
+    else if((lead & 0xf8) == 0xf0)
+    {
+        length = 3;
+        unicode = lead & 0x07;
+        minimum = 0x10000;
+    }
+    else
+    {
+        return INVALID_UNICODE;
+    }
+    if((size_t)(end - text) < length)
+    {
+        return INVALID_UNICODE;
+    }
+    for(size_t i = 0; i < length; i++)
+    {
+        if((text[i] & 0xc0) != 0x80)
+        {
+            return INVALID_UNICODE;
+        }
+        unicode = (unicode << 6) | (text[i] & 0x3f);
+    }
+    if(unicode < minimum || unicode > MAX_UNICODE || (unicode >= 0xd800 && unicode <= 0xdfff))
+    {
+        return INVALID_UNICODE;
+    }
+    text += length;
+    return unicode;
+}
+
+bool parseHex(const unsigned char*& text, const unsigned char* end, size_t digitNum, unsigned int& value)
+{
+    if((size_t)(end - text) < digitNum)
+    {
+        return false;
+    }
+    value = 0;
+    for(size_t i = 0; i < digitNum; i++)
+    {
+        unsigned char c = text[i];
+        unsigned int digit;
+        if(c >= '0' && c <= '9')
+        {
+            digit = c - '0';
+        }
+        else if(c >= 'a' && c <= 'f')
+        {
+            digit = c - 'a' + 10;
+        }
+        else if(c >= 'A' && c <= 'F')
+        {
+            digit = c - 'A' + 10;
+        }
+        else
+        {
+            return false;
+        }
+        value = (value << 4) | digit;
+    }
+    text += digitNum;
+    return true;
+}
+
+//a code point of a range list, "U+4E00", "0x4e00" or "4E00"
+bool parseCodePoint(const char*& text, unsigned int& unicode)
+{
+    if((text[0] == 'U' || text[0] == 'u') && text[1] == '+')
+    {
+        text += 2;
+    }
+    else if(text[0] == '0' && (text[1] == 'x' || text[1] == 'X'))
+    {
+        text += 2;
+    }
+    char* end;
+    unsigned long value = strtoul(text, &end, 16);
+    if(end == text || *text == '-' || *text == '+' || value > MAX_UNICODE)
+    {
+        return false;
+    }
+    text = end;
+    unicode = value;
+    return true;
+}
+
+std::vector<char> readFile(const char* fileName)
+{
+    std::ifstream stream(fileName, std::ifstream::binary);
+    if(!stream)
+    {
+        std::cerr << "[Error] " << fileName << ": cannot be opened" << std::endl;
+        exit(1);
+    }
+    return std::vector<char>(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+}
+
+}
+
+void CharacterSet::add(unsigned int unicode)
+{
+    addRange(unicode, unicode);
+}
+
+void CharacterSet::addRange(unsigned int first, unsigned int last)
+{
+    last = std::min(last, MAX_UNICODE);
+    if(first > last)
+    {
+        return;
+    }
+    //the ranges that overlap or touch [first, last] are [begin, end)
+    auto begin = std::lower_bound(m_ranges.begin(), m_ranges.end(), first,
+                                  [](const CharacterRange& range, unsigned int unicode) { return range.last + 1 < unicode; });
+    auto end = std::upper_bound(begin, m_ranges.end(), last,
+                                [](unsigned int unicode, const CharacterRange& range) { return unicode + 1 < range.first; });
+    if(begin == end)
+    {
+        m_ranges.insert(begin, CharacterRange{first, last});
+        return;
+    }
+    begin->first = std::min(first, begin->first);
+    begin->last = std::max(last, (end - 1)->last);
+    m_ranges.erase(begin + 1, end);
+}
+
+bool CharacterSet::addRanges(const char* text)
+{
+    std::vector<CharacterRange> ranges;
+    while(*text)
+    {
+        if(*text == ',' || *text == ' ' || *text == '\t' || *text == '\n' || *text == '\r')
+        {
+            text++;
+            continue;
+        }
+        CharacterRange range;
+        if(!parseCodePoint(text, range.first))
+        {
+            return false;
+        }
+        range.last = range.first;
+        if(*text == '-' || (text[0] == '.' && text[1] == '.'))
+        {
+            text += *text == '-' ? 1 : 2;
+            if(!parseCodePoint(text, range.last) || range.last < range.first)
+            {
+                return false;
+            }
+        }
+        if(*text && *text != ',' && *text != ' ' && *text != '\t' && *text != '\n' && *text != '\r')
+        {
+            return false;
+        }
+        ranges.push_back(range);
+    }
+    for(auto iter = ranges.begin(); iter != ranges.end(); iter++)
+    {
+        addRange(iter->first, iter->last);
+    }
+    return true;
+}
+
+void CharacterSet::addText(const std::u32string& text)
+{
+    for(auto iter = text.begin(); iter != text.end(); iter++)
+    {
+        add(*iter);
+    }
+}
+
+void CharacterSet::addUtf8(const char* text, size_t length)
+{
+    const unsigned char* position = reinterpret_cast<const unsigned char*>(text);
+    const unsigned char* end = position + length;
+    while(position < end)
+    {
+        unsigned int unicode = decodeUtf8(position, end);
+        if(unicode != INVALID_UNICODE)
+        {
+            add(unicode);
+        }
+    }
+}
+
+void CharacterSet::addCharacterFile(const char* fileName)
+{
+    std::vector<char> file = readFile(fileName);
+    const unsigned char* position = reinterpret_cast<const unsigned char*>(file.data());
+    const unsigned char* end = position + file.size();
+    while(position < end)
+    {
+        unsigned int unicode = decodeUtf8(position, end);
+        //no glyph is drawn for controls and the byte order mark
+        if(unicode != INVALID_UNICODE && unicode >= 0x20 && unicode != 0x7f && unicode != 0xfeff)
+        {
+            add(unicode);
+        }
+    }
+}
+
+void CharacterSet::addStringTable(const char* fileName)
+{
+    std::vector<char> file = readFile(fileName);
+    const unsigned char* position = reinterpret_cast<const unsigned char*>(file.data());
+    const unsigned char* end = position + file.size();
+    bool quoted = false;
+    unsigned int highSurrogate = 0;  //of a \uXXXX\uXXXX pair
+    while(position < end)
+    {
+        if(!quoted)
+        {
+            quoted = *position++ == '"';
+            continue;
+        }
+        unsigned int unicode = INVALID_UNICODE;
+        if(*position == '"')
+        {
+            quoted = false;
+            position++;
+        }
+        else if(*position == '\\' && end - position >= 2)
+        {
+            unsigned char escape = position[1];
+            position += 2;
+            unsigned int value;
+            if(escape == 'u' && parseHex(position, end, 4, value))
+            {
+                unicode = value;
+            }
+            else if(escape == 'U' && parseHex(position, end, 8, value))
+            {
+                unicode = value;
+            }
+            else if(escape == '"' || escape == '\\' || escape == '\'' || escape == '/')
+            {
+                unicode = escape;
+            }
+        }
+        else
+        {
+            unicode = decodeUtf8(position, end);
+        }
+
+        if(unicode >= 0xd800 && unicode <= 0xdbff)
+        {
+            highSurrogate = unicode;
+            continue;
+        }
+        if(unicode >= 0xdc00 && unicode <= 0xdfff)
+        {
+            unicode = highSurrogate ? 0x10000 + ((highSurrogate - 0xd800) << 10) + (unicode - 0xdc00) : INVALID_UNICODE;
+        }
+        highSurrogate = 0;
+        if(unicode != INVALID_UNICODE && unicode >= 0x20 && unicode != 0x7f && unicode <= MAX_UNICODE)
+        {
+            add(unicode);
+        }
+    }
+}
+
+void CharacterSet::clear()
+{
+    m_ranges.clear();
+}
+
+bool CharacterSet::empty() const
+{
+    return m_ranges.empty();
+}
+
+bool CharacterSet::contains(unsigned int unicode) const
+{
+    auto iter = std::upper_bound(m_ranges.begin(), m_ranges.end(), unicode,
+                                 [](unsigned int unicode, const CharacterRange& range) { return unicode < range.first; });
+    return iter != m_ranges.begin() && (iter - 1)->last >= unicode;
+}
+
+size_t CharacterSet::size() const
+{
+    size_t size = 0;
+    for(auto iter = m_ranges.begin(); iter != m_ranges.end(); iter++)
+    {
+        size += iter->last - iter->first + 1;
+    }
+    return size;
+}
+
+const std::vector<CharacterRange>& CharacterSet::ranges() const
+{
+    return m_ranges;
+}
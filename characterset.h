@@ -0,0 +1,41 @@
+#ifndef CHARACTERSET_H
+#define CHARACTERSET_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+struct CharacterRange
+{
+    unsigned int first;
+    unsigned int last;  //inclusive
+};
+
+//a set of code points of U+0000..U+10FFFF, kept as sorted disjoint ranges; adjacent ranges are merged
+class CharacterSet final
+{
+public:
+    void add(unsigned int unicode);
+    void addRange(unsigned int first, unsigned int last);
+    //hexadecimal code points and ranges separated by commas or white space, with an optional U+ or 0x,
+    //e.g. "U+0020-007E, U+3000..U+303F 4E00-9FA5"; returns false and adds nothing on a syntax error
+    bool addRanges(const char* text);
+    void addText(const std::u32string& text);
+    void addUtf8(const char* text, size_t length);  //malformed sequences are skipped
+    //every character of a UTF-8 text file except line breaks and other control characters
+    void addCharacterFile(const char* fileName);
+    //the characters of every double-quoted literal of a UTF-8 string table, as in JSON, .po files or
+    //C-like sources; \uXXXX and \UXXXXXXXX escapes are decoded
+    void addStringTable(const char* fileName);
+    void clear();
+
+    bool empty() const;
+    bool contains(unsigned int unicode) const;
+    size_t size() const;  //code points
+    const std::vector<CharacterRange>& ranges() const;
+
+private:
+    std::vector<CharacterRange> m_ranges;
+};
+
+#endif // CHARACTERSET_H
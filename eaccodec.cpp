@@ -0,0 +1,208 @@
+#include "eaccodec.h"
+#include <cstdint>
+#include <climits>
+#include <algorithm>
+
+#define EAC_MAX_VALUE 2047
+
+namespace
+{
+
+//the modifier tables of the ETC2 specification, index 3 is the most negative and 7 the most positive of every table
+const int modifierTables[16][8] = {
+    {-3, -6, -9, -15, 2, 5, 8, 14},
+    {-3, -7, -10, -13, 2, 6, 9, 12},
+    {-2, -5, -8, -13, 1, 4, 7, 12},
+    {-2, -4, -6, -13, 1, 3, 5, 12},
+    {-3, -6, -8, -12, 2, 5, 7, 11},
+    {-3, -7, -9, -11, 2, 6, 8, 10},
+    {-4, -7, -8, -11, 3, 6, 7, 10},
+    {-3, -5, -8, -11, 2, 4, 7, 10},
+    {-2, -6, -8, -10, 1, 5, 7, 9},
+    {-2, -5, -8, -10, 1, 4, 7, 9},
+    {-2, -4, -8, -10, 1, 3, 7, 9},
+    {-2, -5, -7, -10, 1, 4, 6, 9},
+    {-3, -4, -7, -10, 2, 3, 6, 9},
+    {-1, -2, -3, -10, 0, 1, 2, 9},
+    {-4, -6, -8, -9, 3, 5, 7, 8},
+    {-3, -5, -7, -9, 2, 4, 6, 8}
+};
+
+//the 11 bit value a modifier decodes to; a multiplier of 0 means 1/8
+inline int eacValue(int base, int multiplier, int modifier)
+{
+    int value = base * 8 + 4 + (multiplier ? modifier * multiplier * 8 : modifier);
+    return std::min(std::max(value, 0), EAC_MAX_VALUE);
+}
+
+inline int to11Bit(unsigned char value)
+{
+    return (value * EAC_MAX_VALUE + 127) / 255;
+}
+
+inline unsigned char to8Bit(int value)
+{
+    return (value * 255 + EAC_MAX_VALUE / 2) / EAC_MAX_VALUE;
+}
+
+//pixel i of a block is column i / 4, row i % 4; its index takes bits 47 - 3i..45 - 3i of the big endian word
+inline uint64_t packBlock(int base, int multiplier, int table, uint64_t indices)
+{
+    return (uint64_t)base << 56 | (uint64_t)multiplier << 52 | (uint64_t)table << 48 | indices;
+}
+
+void storeBlock(uint64_t word, unsigned char* block)
+{
+    for(int i = 0; i < EAC_BLOCK_BYTES; i++)
+    {
+        block[i] = word >> (56 - 8 * i);
+    }
+}
+
+//squared error of the best modifier of every pixel, gives up once it reaches bestError
+unsigned int fitBlock(const int* values, int base, int multiplier, const int* modifiers, unsigned int bestError, uint64_t& indices)
+{
+    int decoded[8];
+    for(int j = 0; j < 8; j++)
+    {
+        decoded[j] = eacValue(base, multiplier, modifiers[j]);
+    }
+    unsigned int error = 0;
+    indices = 0;
+    for(int i = 0; i < 16; i++)
+    {
+        unsigned int pixelError = UINT_MAX;
+        int index = 0;
+        for(int j = 0; j < 8; j++)
+        {
+            int difference = values[i] - decoded[j];
+            unsigned int candidate = difference * difference;
+            if(candidate < pixelError)
+            {
+                pixelError = candidate;
+                index = j;
+            }
+        }
+        error += pixelError;
+        if(error >= bestError)
+        {
+            return error;
+        }
+        indices |= (uint64_t)index << (45 - 3 * i);
+    }
+    return error;
+}
+
+//for every table the multipliers around the one whose modifiers span the block, and the bases that
+//centre them on it; clamping at 0 and 2047 keeps empty and full coverage exact
+uint64_t encodeBlock(const int* values)
+{
+    int low = *std::min_element(values, values + 16);
+    int high = *std::max_element(values, values + 16);
+    unsigned int bestError = UINT_MAX;
+    uint64_t best = 0;
+    for(int table = 0; table < 16 && bestError != 0; table++)
+    {
+        const int* modifiers = modifierTables[table];
+        int span = (modifiers[7] - modifiers[3]) * 8;
+        int fitting = std::min(std::max((high - low + span / 2) / span, 1), 15);
+        for(int multiplier = std::max(fitting - 1, 1); multiplier <= std::min(fitting + 1, 15); multiplier++)
+        {
+            int center = (low + high) / 2 - 4 - (modifiers[3] + modifiers[7]) * multiplier * 4;
+            int centerBase = std::min(std::max((center + 4) >> 3, 0), 255);
+            for(int base = std::max(centerBase - 1, 0); base <= std::min(centerBase + 1, 255); base++)
+            {
+                uint64_t indices;
+                unsigned int error = fitBlock(values, base, multiplier, modifiers, bestError, indices);
+                if(error < bestError)
+                {
+                    bestError = error;
+                    best = packBlock(base, multiplier, table, indices);
+                }
+            }
+        }
+    }
+    return best;
+}
+
+//most of an atlas is empty or fully covered, a block of one value is looked up
+struct UniformBlocks
+{
+    UniformBlocks()
+    {
+        for(int value = 0; value < 256; value++)
+        {
+            int values[16];
+            std::fill(values, values + 16, to11Bit(value));
+            words[value] = encodeBlock(values);
+        }
+    }
+
+    uint64_t words[256];
+};
+
+} // namespace
+
+size_t eacBlockRowBytes(unsigned int width)
+{
+    return (size_t)(width + EAC_BLOCK_SIZE - 1) / EAC_BLOCK_SIZE * EAC_BLOCK_BYTES;
+}
+
+size_t eacImageBytes(unsigned int width, unsigned int height)
+{
+    return eacBlockRowBytes(width) * ((height + EAC_BLOCK_SIZE - 1) / EAC_BLOCK_SIZE);
+}
+
+void encodeEacR11(const unsigned char* image, size_t stride, unsigned int width, unsigned int height,
+                  unsigned int firstBlockRow, unsigned int blockRowNum, unsigned char* blocks)
+{
+    static const UniformBlocks uniformBlocks;
+    unsigned int blockColumnNum = (width + EAC_BLOCK_SIZE - 1) / EAC_BLOCK_SIZE;
+    for(unsigned int blockRow = firstBlockRow; blockRow < firstBlockRow + blockRowNum; blockRow++)
+    {
+        for(unsigned int blockColumn = 0; blockColumn < blockColumnNum; blockColumn++)
+        {
+            int values[16];
+            bool uniform = true;
+            unsigned char first = image[(size_t)blockRow * EAC_BLOCK_SIZE * stride + blockColumn * EAC_BLOCK_SIZE];
+            for(int i = 0; i < 16; i++)
+            {
+                unsigned int x = std::min(blockColumn * EAC_BLOCK_SIZE + i / 4, width - 1);
+                unsigned int y = std::min(blockRow * EAC_BLOCK_SIZE + i % 4, height - 1);
+                unsigned char value = image[(size_t)y * stride + x];
+                uniform = uniform && value == first;
+                values[i] = to11Bit(value);
+            }
+            storeBlock(uniform ? uniformBlocks.words[first] : encodeBlock(values), blocks);
+            blocks += EAC_BLOCK_BYTES;
+        }
+    }
+}
+
+void decodeEacR11(const unsigned char* blocks, unsigned int width, unsigned int height, unsigned char* image, size_t stride)
+{
+    for(unsigned int blockY = 0; blockY < height; blockY += EAC_BLOCK_SIZE)
+    {
+        for(unsigned int blockX = 0; blockX < width; blockX += EAC_BLOCK_SIZE)
+        {
+            uint64_t word = 0;
+            for(int i = 0; i < EAC_BLOCK_BYTES; i++)
+            {
+                word = word << 8 | blocks[i];
+            }
+            blocks += EAC_BLOCK_BYTES;
+            int base = word >> 56;
+            int multiplier = (word >> 52) & 15;
+            const int* modifiers = modifierTables[(word >> 48) & 15];
+            for(int i = 0; i < 16; i++)
+            {
+                unsigned int x = blockX + i / 4;
+                unsigned int y = blockY + i % 4;
+                if(x < width && y < height)
+                {
+                    image[(size_t)y * stride + x] = to8Bit(eacValue(base, multiplier, modifiers[(word >> (45 - 3 * i)) & 7]));
+                }
+            }
+        }
+    }
+}
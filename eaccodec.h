@@ -0,0 +1,24 @@
+#ifndef EACCODEC_H
+#define EACCODEC_H
+
+#include <cstddef>
+
+//EAC R11 (GL_COMPRESSED_R11_EAC, core in OpenGL ES 3.0) of single channel 8 bit images: a block of
+//4x4 pixels is 8 bytes, a base value, a multiplier and one of 16 tables of 8 modifiers followed by
+//a 3 bit modifier index per pixel, so the image takes half the memory of GL_R8. Rows of blocks
+//follow each other top down, like glCompressedTexImage3D expects them
+
+#define EAC_BLOCK_SIZE 4   //pixels per side of a block
+#define EAC_BLOCK_BYTES 8
+
+size_t eacBlockRowBytes(unsigned int width);  //a row of blocks covering width pixels
+size_t eacImageBytes(unsigned int width, unsigned int height);
+//the block rows firstBlockRow..firstBlockRow + blockRowNum - 1 of a width x height image whose row i
+//starts at image + i * stride; blocks receives them from the first one on. Blocks reaching past the
+//image repeat its last row and column
+void encodeEacR11(const unsigned char* image, size_t stride, unsigned int width, unsigned int height,
+                  unsigned int firstBlockRow, unsigned int blockRowNum, unsigned char* blocks);
+//back to 8 bit the way a GPU samples the texture into an 8 bit framebuffer, value / 2047 rounded to 1/255
+void decodeEacR11(const unsigned char* blocks, unsigned int width, unsigned int height, unsigned char* image, size_t stride);
+
+#endif // EACCODEC_H
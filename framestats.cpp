@@ -0,0 +1,99 @@
+#include "framestats.h"
+#include <algorithm>
+
+FrameStatsHistory::FrameStatsHistory(size_t capacity)
+    :m_capacity(std::max((size_t)1, capacity))
+    ,m_next(0)
+{
+    m_frames.reserve(m_capacity);
+}
+
+void FrameStatsHistory::add(const FrameStats& stats)
+{
+    if(m_frames.size() < m_capacity)
+    {
+        m_frames.push_back(stats);
+    }
+    else
+    {
+        m_frames[m_next] = stats;
+    }
+    m_next = (m_next + 1) % m_capacity;
+}
+
+void FrameStatsHistory::clear()
+{
+    m_frames.clear();
+    m_next = 0;
+}
+
+size_t FrameStatsHistory::frameNum() const
+{
+    return m_frames.size();
+}
+
+const FrameStats& FrameStatsHistory::frame(size_t i) const
+{
+    //until the ring is full m_next is m_frames.size() and the oldest frame is at 0
+    return m_frames[(m_frames.size() < m_capacity ? i : m_next + i) % m_capacity];
+}
+
+const FrameStats& FrameStatsHistory::last() const
+{
+    return frame(m_frames.size() - 1);
+}
+
+FrameTimeSummary FrameStatsHistory::cpuTimeSummary() const
+{
+    return summary(&FrameStats::cpuTime);
+}
+
+FrameTimeSummary FrameStatsHistory::frameTimeSummary() const
+{
+    return summary(&FrameStats::frameTime);
+}
+
+FrameStats FrameStatsHistory::total() const
+{
+    FrameStats total{0.0, 0.0, 0, 0, 0, 0, 0, 0, 0};
+    for(auto iter = m_frames.begin(); iter != m_frames.end(); iter++)
+    {
+        total.cpuTime += iter->cpuTime;
+        total.frameTime += iter->frameTime;
+        total.drawCallNum += iter->drawCallNum;
+        total.glyphNum += iter->glyphNum;
+        total.uploadedByteNum += iter->uploadedByteNum;
+        total.layoutCacheHits += iter->layoutCacheHits;
+        total.layoutCacheMisses += iter->layoutCacheMisses;
+        total.glyphCacheHits += iter->glyphCacheHits;
+        total.glyphCacheMisses += iter->glyphCacheMisses;
+    }
+    if(!m_frames.empty())
+    {
+        total.cpuTime /= m_frames.size();
+        total.frameTime /= m_frames.size();
+    }
+    return total;
+}
+
+//nearest rank percentiles
+FrameTimeSummary FrameStatsHistory::summary(double FrameStats::*time) const
+{
+    FrameTimeSummary summary{m_frames.size(), 0.0, 0.0, 0.0, 0.0};
+    if(m_frames.empty())
+    {
+        return summary;
+    }
+    std::vector<double> times(m_frames.size());
+    for(size_t i = 0; i < m_frames.size(); i++)
+    {
+        times[i] = m_frames[i].*time;
+        summary.average += times[i];
+    }
+    summary.average /= times.size();
+    std::sort(times.begin(), times.end());
+    summary.p50 = times[(times.size() - 1) / 2];
+    summary.p99 = times[std::min(times.size() - 1, (times.size() * 99 + 99) / 100 - 1)];
+    summary.max = times.back();
+    return summary;
+}
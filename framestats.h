@@ -0,0 +1,53 @@
+#ifndef FRAMESTATS_H
+#define FRAMESTATS_H
+
+#include <cstddef>
+#include <vector>
+
+struct FrameStats
+{
+    double cpuTime;    //in millisecond, filling the batches, uploading the atlas and issuing the draw calls
+    double frameTime;  //in millisecond, since the previous frame started, or until glFinish() returned
+    unsigned int drawCallNum;
+    size_t glyphNum;  //drawn
+    size_t uploadedByteNum;  //atlas pixels sent to the GPU
+    unsigned long long layoutCacheHits;
+    unsigned long long layoutCacheMisses;
+    unsigned long long glyphCacheHits;    //dynamic atlas
+    unsigned long long glyphCacheMisses;  //dynamic atlas, every miss rasterizes a glyph
+};
+
+struct FrameTimeSummary
+{
+    size_t frameNum;
+    double average;  //in millisecond
+    double p50;
+    double p99;
+    double max;
+};
+
+//the stats of the last capacity frames
+class FrameStatsHistory final
+{
+public:
+    explicit FrameStatsHistory(size_t capacity = 1024);
+
+    void add(const FrameStats& stats);
+    void clear();
+    size_t frameNum() const;  //kept, at most capacity
+    const FrameStats& frame(size_t i) const;  //0 is the oldest kept frame
+    const FrameStats& last() const;
+    FrameTimeSummary cpuTimeSummary() const;
+    FrameTimeSummary frameTimeSummary() const;
+    FrameStats total() const;  //counters summed and times averaged over the kept frames
+
+private:
+    FrameTimeSummary summary(double FrameStats::*time) const;
+
+private:
+    std::vector<FrameStats> m_frames;  //ring
+    size_t m_capacity;
+    size_t m_next;
+};
+
+#endif // FRAMESTATS_H
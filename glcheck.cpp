@@ -0,0 +1,35 @@
+#include "glcheck.h"
+
+QString getGLErrorString(GLenum err)
+{
+    switch(err)
+    {
+    case GL_NO_ERROR:
+        return QString("GL_NO_ERROR: No error has been recorded.");
+        break;
+    case GL_INVALID_ENUM:
+        return QString("GL_INVALID_ENUM: An unacceptable value is specified for an enumerated argument.");
+        break;
+    case GL_INVALID_VALUE:
+        return QString("GL_INVALID_VALUE: A numeric argument is out of range.");
+        break;
+    case GL_INVALID_OPERATION:
+        return QString("GL_INVALID_OPERATION: The specified operation is not allowed in the current state.");
+        break;
+    case GL_INVALID_FRAMEBUFFER_OPERATION:
+        return QString("GL_INVALID_FRAMEBUFFER_OPERATION: The framebuffer object is not complete.");
+        break;
+    case GL_OUT_OF_MEMORY:
+        return QString("GL_OUT_OF_MEMORY: There is not enough memory left to execute the command.");
+        break;
+    case GL_STACK_UNDERFLOW:
+        return QString("GL_STACK_UNDERFLOW: An attempt has been made to perform an operation that would cause an internal stack to underflow.");
+        break;
+    case GL_STACK_OVERFLOW:
+        return QString("GL_STACK_OVERFLOW: An attempt has been made to perform an operation that would cause an internal stack to overflow.");
+        break;
+    default:
+        return QString("");
+        break;
+    }
+}
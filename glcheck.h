@@ -0,0 +1,26 @@
+#ifndef GLCHECK_H
+#define GLCHECK_H
+
+#include <QOpenGLExtraFunctions>
+#include <QString>
+#include <QDebug>
+
+QString getGLErrorString(GLenum err);
+
+//glGetError() waits for the driver to catch up, so release builds don't check at all
+#ifndef QT_NO_DEBUG
+#define CHECK_OPENGL_ES_ERROR(x) do { \
+        x; \
+        GLenum error = glGetError(); \
+        if(error != GL_NO_ERROR) { \
+            qDebug() << QString("[Error] %1, Line %2: %3").arg(__FILE__).arg(__LINE__).arg(getGLErrorString(error)); \
+            exit(1); \
+        } \
+    } while(0)
+#else
+#define CHECK_OPENGL_ES_ERROR(x) do { \
+        x; \
+    } while(0)
+#endif
+
+#endif // GLCHECK_H
@@ -1,8 +1,12 @@
 #include "oglwidget.h"
+#include "glcheck.h"
 #include <QVector>
 #include <QDebug>
+#include <QFile>
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
+#include <algorithm>
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
@@ -12,81 +16,64 @@
 #include FT_RENDER_H
 
 #define TRUNC(x) ((x) >> 6)
-#define CHECK_OPENGL_ES_ERROR(x) do { \
-        x; \
-        GLenum error = glGetError(); \
-        if(error != GL_NO_ERROR) { \
-            qDebug() << QString("[Error] %1, Line %2: %3").arg(__FILE__).arg(__LINE__).arg(getGLErrorString(error)); \
-            exit(1); \
-        } \
-    } while(0)
-
-QString getGLErrorString(GLenum err)
-{
-    switch(err)
+#define FONT_UPLOAD_BYTES_PER_FRAME (4 * 1024 * 1024)  //the rest of a large atlas follows in later frames
+#define STATS_OVERLAY_LINE_HEIGHT 18.0f  //in pixel
+#define STATS_OVERLAY_MARGIN 8.0f        //in pixel
+#define STATS_OVERLAY_REFRESH_FRAMES 60  //between updates of the overlay text, it summarizes the frameStats history
+
+//corners of the six cube faces: top left, bottom left, top right, bottom right of the glyph
+static const GLfloat cubeFaceCorners[6][4][3] = {
+    {
+        {-0.5f, -0.5f, -0.5f},
+        {-0.5f, 0.5f, -0.5f},
+        {0.5f, -0.5f, -0.5f},
+        {0.5f, 0.5f, -0.5f}
+    },
+    {
+        {-0.5f, 0.5f, -0.5f},
+        {-0.5f, 0.5f, 0.5f},
+        {0.5f, 0.5f, -0.5f},
+        {0.5f, 0.5f, 0.5f}
+    },
+    {
+        {-0.5f, 0.5f, 0.5f},
+        {-0.5f, -0.5f, 0.5f},
+        {0.5f, 0.5f, 0.5f},
+        {0.5f, -0.5f, 0.5f}
+    },
     {
-    case GL_NO_ERROR:
-        return QString("GL_NO_ERROR: No error has been recorded.");
-        break;
-    case GL_INVALID_ENUM:
-        return QString("GL_INVALID_ENUM: An unacceptable value is specified for an enumerated argument.");
-        break;
-    case GL_INVALID_VALUE:
-        return QString("GL_INVALID_VALUE: A numeric argument is out of range.");
-        break;
-    case GL_INVALID_OPERATION:
-        return QString("GL_INVALID_OPERATION: The specified operation is not allowed in the current state.");
-        break;
-    case GL_INVALID_FRAMEBUFFER_OPERATION:
-        return QString("GL_INVALID_FRAMEBUFFER_OPERATION: The framebuffer object is not complete.");
-        break;
-    case GL_OUT_OF_MEMORY:
-        return QString("GL_OUT_OF_MEMORY: There is not enough memory left to execute the command.");
-        break;
-    case GL_STACK_UNDERFLOW:
-        return QString("GL_STACK_UNDERFLOW: An attempt has been made to perform an operation that would cause an internal stack to underflow.");
-        break;
-    case GL_STACK_OVERFLOW:
-        return QString("GL_STACK_OVERFLOW: An attempt has been made to perform an operation that would cause an internal stack to overflow.");
-        break;
-    default:
-        return QString("");
-        break;
+        {-.5f, -.5f, .5f},
+        {-.5f, -.5f, -.5f},
+        {.5f, -.5f, .5f},
+        {.5f, -.5f, -.5f}
+    },
+    {
+        {-.5f, .5f, .5f},
+        {-.5f, .5f, -.5f},
+        {-.5f, -.5f, .5f},
+        {-.5f, -.5f, -.5f}
+    },
+    {
+        {.5f, .5f, .5f},
+        {.5f, -.5f, .5f},
+        {.5f, .5f, -.5f},
+        {.5f, -.5f, -.5f}
     }
-}
+};
 
 OGLWidget::OGLWidget(QWidget* parent, Qt::WindowFlags f)
     :QOpenGLWidget(parent, f)
+    ,glFontTexturePageNum(0)
+    ,glMaxArrayTextureLayers(0)
     ,timer(nullptr)
     ,texFont(nullptr)
+    ,layoutCache(nullptr)
+    ,textBatch(nullptr)
+    ,overlayBatch(nullptr)
+    ,atlasUploader(nullptr)
+    ,statsOverlay(false)
+    ,statsOverlayAge(0)
 {
-    texFont = new TextureFont("/usr/share/fonts/opentype/noto/NotoSansCJK-Regular.ttc", 12, 96, 96);
-//    texFont->saveToTextureFile("/home/tang/texFont.tf");
-//    texFont = new TextureFont("/home/tang/texFont.tf");
-
-//    CharacterImage chimage = texFont->characterImage(QString("北").unicode()->unicode());
-//    for(unsigned int i = 0; i < chimage.height(); i++)
-//    {
-//        for(unsigned int j = 0; j < chimage.width(); j++)
-//        {
-//            printf("%d ", chimage.image()[i*chimage.width()+j]>0?1:0);
-//        }
-//        printf("\n");
-//    }
-
-//    glyphImage = QImage(texFont->texture(),
-//                      texFont->textureWidth(),
-//                      texFont->textureHeight(),
-//                      texFont->textureWidth(),
-//                      QImage::Format_Indexed8);
-//    QVector<QRgb> colorTable;
-//    for(int i = 0; i < 256; ++i)
-//    {
-//        colorTable << qRgba(0, 0, 0, i);
-//    }
-//    glyphImage.setColorTable(colorTable);
-//    glyphImage.save("/home/tang/texFont.png");
-
     timer = new QTimer(this);
     timer->setInterval(0);
     connect(timer, SIGNAL(timeout()), this, SLOT(update()));
@@ -102,6 +89,12 @@ OGLWidget::OGLWidget(QWidget* parent, Qt::WindowFlags f)
 
 OGLWidget::~OGLWidget()
 {
+    makeCurrent();
+    delete textBatch;
+    delete overlayBatch;
+    delete atlasUploader;
+    doneCurrent();
+    delete layoutCache;
     delete texFont;
 }
 
@@ -117,6 +110,45 @@ void OGLWidget::initializeGL()
     }
     initializeOpenGLFunctions();
 
+    GLint maxTextureSize = 0;
+    CHECK_OPENGL_ES_ERROR(glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize));
+    CHECK_OPENGL_ES_ERROR(glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &glMaxArrayTextureLayers));
+
+    //glyphs are rasterized on their first lookup and uploaded by updateFontTexture(),
+    //as distance fields they stay sharp however large the cube is drawn
+    TextureFontOptions fontOptions;
+    fontOptions.maxTextureSize = maxTextureSize;
+    fontOptions.dynamicAtlas = true;
+    fontOptions.maxPageNum = 4;
+    fontOptions.packingStrategy = PackingStrategy::Skyline;
+    fontOptions.signedDistanceField = true;
+    texFont = new TextureFont("/usr/share/fonts/opentype/noto/NotoSansCJK-Regular.ttc", 32, 96, 96, fontOptions);
+//    texFont->saveToTextureFile("/home/tang/texFont.tf");
+//    texFont = new TextureFont("/home/tang/texFont.tf");
+
+//    CharacterImage chimage = texFont->characterImage(QString("北").unicode()->unicode());
+//    for(unsigned int i = 0; i < chimage.height(); i++)
+//    {
+//        for(unsigned int j = 0; j < chimage.width(); j++)
+//        {
+//            printf("%d ", chimage.image()[i*chimage.width()+j]>0?1:0);
+//        }
+//        printf("\n");
+//    }
+
+//    glyphImage = QImage(texFont->texture(0),
+//                      texFont->textureWidth(),
+//                      texFont->textureHeight(),
+//                      texFont->textureWidth(),
+//                      QImage::Format_Indexed8);
+//    QVector<QRgb> colorTable;
+//    for(int i = 0; i < 256; ++i)
+//    {
+//        colorTable << qRgba(0, 0, 0, i);
+//    }
+//    glyphImage.setColorTable(colorTable);
+//    glyphImage.save("/home/tang/texFont.png");
+
 //    GLfloat tmpCubeVertex[24] = {
 //        -0.5f, -0.5f, -0.5f,
 //        0.5f, -0.5f, -0.5f,
@@ -141,120 +173,44 @@ void OGLWidget::initializeGL()
 //        0, 2, 1
 //    };
 
-    GLfloat tmpCubeVertex[6][12] = {
-        {
-            -0.5f, -0.5f, -0.5f,
-            -0.5f, 0.5f, -0.5f,
-            0.5f, -0.5f, -0.5f,
-            0.5f, 0.5f, -0.5f
-        },
-        {
-            -0.5f, 0.5f, -0.5f,
-            -0.5f, 0.5f, 0.5f,
-            0.5f, 0.5f, -0.5f,
-            0.5f, 0.5f, 0.5f
-        },
-        {
-            -0.5f, 0.5f, 0.5f,
-            -0.5f, -0.5f, 0.5f,
-            0.5f, 0.5f, 0.5f,
-            0.5f, -0.5f, 0.5f
-        },
-        {
-            -.5f, -.5f, .5f,
-            -.5f, -.5f, -.5f,
-            .5f, -.5f, .5f,
-            .5f, -.5f, -.5f
-        },
-        {
-            -.5f, .5f, .5f,
-            -.5f, .5f, -.5f,
-            -.5f, -.5f, .5f,
-            -.5f, -.5f, -.5f
-        },
-        {
-            .5f, .5f, .5f,
-            .5f, -.5f, .5f,
-            .5f, .5f, -.5f,
-            .5f, -.5f, -.5f
-        }
-    };
+    //labels that stay the same from frame to frame are laid out once
+    layoutCache = new TextLayoutCache();
+    textBatch = new TextBatch(texFont, layoutCache);
+    textBatch->initializeGL();
+    overlayBatch = new TextBatch(texFont, layoutCache);
+    overlayBatch->initializeGL();
 
-    CHECK_OPENGL_ES_ERROR(glGenBuffers(6, glCubeVertexBuffer));
-    for(int i = 0; i < 6; i++)
-    {
-        CHECK_OPENGL_ES_ERROR(glBindBuffer(GL_ARRAY_BUFFER, glCubeVertexBuffer[i]));
-        CHECK_OPENGL_ES_ERROR(glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)*12, tmpCubeVertex[i], GL_STATIC_DRAW));
-    }
+    atlasUploader = new AtlasUploader();
+    atlasUploader->initializeGL();
 
-    QString texWords[6] = {"1", "2", "水", "4", "5", "6"};
+    //every atlas page is one layer of the array texture
+    CHECK_OPENGL_ES_ERROR(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+    CHECK_OPENGL_ES_ERROR(glGenTextures(1, &glFontTexture));
+    CHECK_OPENGL_ES_ERROR(glBindTexture(GL_TEXTURE_2D_ARRAY, glFontTexture));
+    //distance fields are interpolated, coverage is sampled as it is; the coverage4 and LCD shaders fetch texels
+    GLint fontTextureFilter = texFont->signedDistanceField() ? GL_LINEAR : GL_NEAREST;
+    CHECK_OPENGL_ES_ERROR(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, fontTextureFilter));
+    CHECK_OPENGL_ES_ERROR(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, fontTextureFilter));
+    updateFontTexture();
 
-    GLfloat tmpCubeTexCoord[6][8];
-    for(int i = 0; i < 6; i++)
+    //the coverage4 and LCD shaders fetch texels, the SDF shader thresholds the interpolated distance
+    const char* fragmentShaderFile = ":/fragment_shader/simplefrag.fsh";
+    if(texFont->signedDistanceField())
     {
-        TextureCoord coord = texFont->textureCoord(texWords[i].unicode()->unicode());
-        tmpCubeTexCoord[i][0] = coord.left;
-        tmpCubeTexCoord[i][1] = coord.top;
-        tmpCubeTexCoord[i][2] = coord.left;
-        tmpCubeTexCoord[i][3] = coord.bottom;
-        tmpCubeTexCoord[i][4] = coord.right;
-        tmpCubeTexCoord[i][5] = coord.top;
-        tmpCubeTexCoord[i][6] = coord.right;
-        tmpCubeTexCoord[i][7] = coord.bottom;
+        fragmentShaderFile = ":/fragment_shader/sdffrag.fsh";
     }
-
-    CHECK_OPENGL_ES_ERROR(glGenBuffers(6, glCubeTexCoordBuffer));
-    for(int i = 0; i < 6; i++)
+    else if(texFont->atlasFormat() == AtlasFormat::Coverage4)
     {
-        CHECK_OPENGL_ES_ERROR(glBindBuffer(GL_ARRAY_BUFFER, glCubeTexCoordBuffer[i]));
-        CHECK_OPENGL_ES_ERROR(glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)*8, tmpCubeTexCoord[i], GL_STATIC_DRAW));
+        fragmentShaderFile = ":/fragment_shader/coverage4frag.fsh";
+    }
+    else if(texFont->atlasFormat() == AtlasFormat::LCD)
+    {
+        fragmentShaderFile = ":/fragment_shader/lcdfrag.fsh";
     }
 
-    CHECK_OPENGL_ES_ERROR(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
-    CHECK_OPENGL_ES_ERROR(glGenTextures(1, &glFontTexture));
-    CHECK_OPENGL_ES_ERROR(glBindTexture(GL_TEXTURE_2D, glFontTexture));
-    CHECK_OPENGL_ES_ERROR(glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, texFont->textureWidth(), texFont->textureHeight(), 0, GL_RED, GL_UNSIGNED_BYTE, texFont->texture()));
-    CHECK_OPENGL_ES_ERROR(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
-    CHECK_OPENGL_ES_ERROR(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
-
-    const char* vShaderStr =
-        "#version 300 es\n"
-        "layout(location = 0) in vec4 vPosition;\n"
-        "layout(location = 1) in vec2 vTexCoord;\n"
-        "out vec2 v_TexCoord;\n"
-        "void main()\n"
-        "{\n"
-        "    gl_Position = vPosition;\n"
-        "    v_TexCoord = vTexCoord;\n"
-        "}\n";
-
-    const char* fShaderStr =
-            "#version 300 es\n"
-            "precision mediump float;\n"
-            "uniform sampler2D s_tex0;\n"
-            "in vec2 v_TexCoord;\n"
-            "out vec4 fragColor;\n"
-            "void main()\n"
-            "{\n"
-            "    fragColor = texture(s_tex0, v_TexCoord);\n // * vec4(1.0, 1.0, 1.0, 1.0);\n"
-            "}\n";
-
-    GLuint vertexShader;
-    GLuint fragmentShader;
+    GLuint vertexShader = compileShader(GL_VERTEX_SHADER, ":/vertex_shader/simplevertex.vsh");
+    GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentShaderFile);
     GLint linked;
-    GLint compiled;
-
-    vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vShaderStr, NULL);
-    glCompileShader(vertexShader);
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &compiled);
-    assert(compiled == GL_TRUE);
-
-    fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fShaderStr, NULL);
-    glCompileShader(fragmentShader);
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &compiled);
-    assert(compiled == GL_TRUE);
 
     program = glCreateProgram();
     glAttachShader(program, vertexShader);
@@ -267,6 +223,25 @@ void OGLWidget::initializeGL()
     CHECK_OPENGL_ES_ERROR(glClear(GL_COLOR_BUFFER_BIT));
 }
 
+GLuint OGLWidget::compileShader(GLenum type, const char* fileName)
+{
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        qDebug() << QString("[Error] %1, Line %2: cannot read %3").arg(__FILE__).arg(__LINE__).arg(fileName);
+        exit(1);
+    }
+    QByteArray source = file.readAll();
+    const char* sourceStr = source.constData();
+    GLint compiled;
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &sourceStr, NULL);
+    glCompileShader(shader);
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    assert(compiled == GL_TRUE);
+    return shader;
+}
+
 void OGLWidget::resizeGL(int w, int h)
 {
     glViewport(0, 0, w, h);
@@ -274,26 +249,135 @@ void OGLWidget::resizeGL(int w, int h)
 
 void OGLWidget::paintGL()
 {
+    FrameStats stats{0.0, 0.0, 0, 0, 0, 0, 0, 0, 0};
+    stats.frameTime = frameStats.frameNum() ? frameTimer.nsecsElapsed() / 1e6 : 0.0;
+    frameTimer.start();
+    TextLayoutCacheStats layoutStats = layoutCache->stats();
+    GlyphCacheStats glyphStats = texFont->glyphCacheStats();
+
+    //every glyph of the frame goes into one batch, looking them up may rasterize glyphs
+    //that updateFontTexture() uploads before the batch is drawn
+    fillTextBatch();
+    if(!texFont->takeEvictedCharacters().empty())
+    {
+        //a glyph looked up late in the frame evicted one looked up earlier
+        fillTextBatch();
+    }
+    stats.uploadedByteNum = updateFontTexture();
+    CHECK_OPENGL_ES_ERROR(glClear(GL_COLOR_BUFFER_BIT));
     CHECK_OPENGL_ES_ERROR(glUseProgram(program));
 
     CHECK_OPENGL_ES_ERROR(glActiveTexture(GL_TEXTURE0));
-    CHECK_OPENGL_ES_ERROR(glBindTexture(GL_TEXTURE_2D, glFontTexture));
+    CHECK_OPENGL_ES_ERROR(glBindTexture(GL_TEXTURE_2D_ARRAY, glFontTexture));
     CHECK_OPENGL_ES_ERROR(glUniform1i(glGetUniformLocation(program, "s_tex0"), 0));
 
-    CHECK_OPENGL_ES_ERROR(glEnableVertexAttribArray(0));
-    CHECK_OPENGL_ES_ERROR(glEnableVertexAttribArray(1));
+    //quads of neighbouring glyphs overlap, the coverage and distance field shaders blend by coverage,
+    //LCD text by the coverage of every subpixel towards the text color
+    CHECK_OPENGL_ES_ERROR(glEnable(GL_BLEND));
+    if(texFont->atlasFormat() == AtlasFormat::LCD)
+    {
+        CHECK_OPENGL_ES_ERROR(glBlendColor(1.0f, 0.0f, 0.0f, 1.0f));
+        CHECK_OPENGL_ES_ERROR(glBlendFunc(GL_CONSTANT_COLOR, GL_ONE_MINUS_SRC_COLOR));
+    }
+    else
+    {
+        CHECK_OPENGL_ES_ERROR(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
+    }
+    if(texFont->atlasFormat() != AtlasFormat::Coverage8)
+    {
+        CHECK_OPENGL_ES_ERROR(glUniform2f(glGetUniformLocation(program, "u_atlasSize"), texFont->textureWidth() - 1.0f, texFont->textureHeight() - 1.0f));
+    }
+    GLint transform = glGetUniformLocation(program, "u_transform");
+    CHECK_OPENGL_ES_ERROR(glUniform4f(transform, 1.0f, 1.0f, 0.0f, 0.0f));
+    textBatch->draw();
+    if(statsOverlay)
+    {
+        //the overlay is laid out in pixels from the bottom left corner
+        CHECK_OPENGL_ES_ERROR(glUniform4f(transform, 2.0f / width(), 2.0f / height(), -1.0f, -1.0f));
+        overlayBatch->draw();
+    }
+    CHECK_OPENGL_ES_ERROR(glDisable(GL_BLEND));
+
+    stats.cpuTime = frameTimer.nsecsElapsed() / 1e6;
+    stats.drawCallNum = textBatch->drawCallNum() + (statsOverlay ? overlayBatch->drawCallNum() : 0);
+    stats.glyphNum = textBatch->glyphNum() + (statsOverlay ? overlayBatch->glyphNum() : 0);
+    stats.layoutCacheHits = layoutCache->stats().hits - layoutStats.hits;
+    stats.layoutCacheMisses = layoutCache->stats().misses - layoutStats.misses;
+    stats.glyphCacheHits = texFont->glyphCacheStats().hits - glyphStats.hits;
+    stats.glyphCacheMisses = texFont->glyphCacheStats().misses - glyphStats.misses;
+    frameStats.add(stats);
+}
+
+const FrameStatsHistory& OGLWidget::frameStatsHistory() const
+{
+    return frameStats;
+}
+
+void OGLWidget::setStatsOverlayVisible(bool visible)
+{
+    statsOverlay = visible;
+}
+
+bool OGLWidget::statsOverlayVisible() const
+{
+    return statsOverlay;
+}
+
+void OGLWidget::fillTextBatch()
+{
+    const char32_t texWords[6] = {U'1', U'2', U'水', U'4', U'5', U'6'};
+
+    textBatch->clear();
     for(int i = 0; i < 6; i++)
     {
-        CHECK_OPENGL_ES_ERROR(glBindBuffer(GL_ARRAY_BUFFER, glCubeVertexBuffer[i]));
-        CHECK_OPENGL_ES_ERROR(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (const void *)0));
-        CHECK_OPENGL_ES_ERROR(glBindBuffer(GL_ARRAY_BUFFER, glCubeTexCoordBuffer[i]));
-        CHECK_OPENGL_ES_ERROR(glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (const void *)0));
-//        glEnable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
-//        glEnable(GL_CULL_FACE);
-        CHECK_OPENGL_ES_ERROR(glDrawArrays(GL_TRIANGLE_STRIP, 0, 4));
-//        glDisable(GL_CULL_FACE);
-//        glDisable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+        textBatch->addGlyph(texWords[i], cubeFaceCorners[i]);
+    }
+
+    overlayBatch->clear();
+    if(!statsOverlay)
+    {
+        return;
+    }
+    if(statsOverlayText.empty() || ++statsOverlayAge >= STATS_OVERLAY_REFRESH_FRAMES)
+    {
+        statsOverlayAge = 0;
+        //the text changes rarely, so the layout cache keeps it in between
+        FrameTimeSummary cpuTime = frameStats.cpuTimeSummary();
+        FrameTimeSummary frameTime = frameStats.frameTimeSummary();
+        FrameStats total = frameStats.total();
+        size_t frameNum = std::max((size_t)1, frameStats.frameNum());
+        unsigned long long layoutLookups = total.layoutCacheHits + total.layoutCacheMisses;
+        char text[256];
+        snprintf(text, sizeof(text), "cpu %.2f ms (p99 %.2f)  frame %.2f ms (p99 %.2f)  %.1f draws  %zu glyphs  %zu KB uploaded  layout cache %.0f%%  %llu glyphs rasterized",
+                 cpuTime.p50, cpuTime.p99, frameTime.p50, frameTime.p99, (double)total.drawCallNum / frameNum,
+                 total.glyphNum / frameNum, total.uploadedByteNum / frameNum / 1024,
+                 layoutLookups ? 100.0 * total.layoutCacheHits / layoutLookups : 0.0, total.glyphCacheMisses);
+        statsOverlayText.assign(text, text + strlen(text));
+    }
+    float scale = STATS_OVERLAY_LINE_HEIGHT / texFont->fontMetrics().lineHeight;
+    float baseline = height() - STATS_OVERLAY_MARGIN - texFont->fontMetrics().ascender * scale;
+    overlayBatch->addText(statsOverlayText, STATS_OVERLAY_MARGIN, baseline, 0.0f, scale);
+}
+
+size_t OGLWidget::updateFontTexture()
+{
+    std::vector<DirtyRect> dirtyRects = texFont->takeDirtyRects();
+    if(glFontTexturePageNum != texFont->pageNum())
+    {
+        //pages were added, the array texture is reallocated and filled again over the next frames
+        if(texFont->pageNum() > (unsigned int)glMaxArrayTextureLayers)
+        {
+            qDebug() << QString("[Error] %1, Line %2: the font needs %3 pages, GL_MAX_ARRAY_TEXTURE_LAYERS is %4").arg(__FILE__).arg(__LINE__).arg(texFont->pageNum()).arg(glMaxArrayTextureLayers);
+            exit(1);
+        }
+        atlasUploader->allocate(texFont, glFontTexture);
+        glFontTexturePageNum = texFont->pageNum();
+        atlasUploader->clear();
+        atlasUploader->enqueuePages(texFont);
+    }
+    else
+    {
+        atlasUploader->enqueue(dirtyRects);
     }
-    CHECK_OPENGL_ES_ERROR(glDisableVertexAttribArray(1));
-    CHECK_OPENGL_ES_ERROR(glDisableVertexAttribArray(0));
+    return atlasUploader->upload(texFont, glFontTexture, FONT_UPLOAD_BYTES_PER_FRAME);
 }
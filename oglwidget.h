@@ -8,7 +8,12 @@
 #include <QOpenGLShader>
 #include <QOpenGLShaderProgram>
 #include <QTimer>
+#include <QElapsedTimer>
+#include <string>
 #include "texturefont.h"
+#include "textbatch.h"
+#include "atlasuploader.h"
+#include "framestats.h"
 
 class OGLWidget : public QOpenGLWidget, protected QOpenGLExtraFunctions
 {
@@ -20,14 +25,33 @@ public:
     void resizeGL(int w, int h) Q_DECL_OVERRIDE;
     void paintGL() Q_DECL_OVERRIDE;
 
+    const FrameStatsHistory& frameStatsHistory() const;
+    //draws the summary of the recent frames in the top left corner
+    void setStatsOverlayVisible(bool visible);
+    bool statsOverlayVisible() const;
+
+private:
+    void fillTextBatch();
+    size_t updateFontTexture();  //returns the bytes uploaded
+    GLuint compileShader(GLenum type, const char* fileName);  //from shaderfiles.qrc
+
 private:
-    GLuint glCubeVertexBuffer[6];
-    GLuint glCubeTexCoordBuffer[6];
     GLuint glFontTexture;
+    GLuint glFontTexturePageNum;
+    GLint glMaxArrayTextureLayers;
     GLuint program;
     QImage glyphImage;
     QTimer * timer;
     TextureFont * texFont;
+    TextLayoutCache * layoutCache;
+    TextBatch * textBatch;
+    TextBatch * overlayBatch;
+    AtlasUploader * atlasUploader;
+    FrameStatsHistory frameStats;
+    QElapsedTimer frameTimer;  //restarted by every paintGL()
+    bool statsOverlay;
+    std::u32string statsOverlayText;
+    unsigned int statsOverlayAge;  //frames since statsOverlayText was updated
 };
 
 #endif // OGLWIDGET_H
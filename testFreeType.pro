@@ -6,6 +6,8 @@
 
 QT       += core gui
 
+CONFIG += c++11 thread
+
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 TARGET = testFreeType
@@ -32,19 +34,40 @@ SOURCES += \
         main.cpp \
         widget.cpp \
     oglwidget.cpp \
-    texturefont.cpp
+    texturefont.cpp \
+    eaccodec.cpp \
+    atlaspacker.cpp \
+    characterset.cpp \
+    textbatch.cpp \
+    atlasuploader.cpp \
+    framestats.cpp \
+    textlayout.cpp \
+    textlayoutcache.cpp \
+    glcheck.cpp
 
 HEADERS += \
         widget.h \
     oglwidget.h \
-    texturefont.h
+    texturefont.h \
+    eaccodec.h \
+    atlaspacker.h \
+    characterset.h \
+    textbatch.h \
+    atlasuploader.h \
+    framestats.h \
+    textlayout.h \
+    textlayoutcache.h \
+    glcheck.h
 
 FORMS += \
         widget.ui
 
 DISTFILES += \
     simplevertex.vsh \
-    simplefrag.fsh
+    simplefrag.fsh \
+    sdffrag.fsh \
+    coverage4frag.fsh \
+    lcdfrag.fsh
 
 RESOURCES += \
     shaderfiles.qrc
@@ -0,0 +1,178 @@
+#include "textbatch.h"
+#include "glcheck.h"
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+
+#define MAX_BATCH_GLYPH_NUM 16384  //4 vertices each, addressable by GLushort indices
+#define MIN_VERTEX_BUFFER_SIZE (64 * 1024)
+
+TextBatch::TextBatch(const TextureFont* font, TextLayoutCache* layoutCache)
+    :m_font(font)
+    ,m_layoutCache(layoutCache)
+    ,m_vertexArray(0)
+    ,m_vertexBuffer(0)
+    ,m_indexBuffer(0)
+    ,m_vertexBufferSize(0)
+    ,m_vertexBufferOffset(0)
+    ,m_indexGlyphNum(0)
+    ,m_drawCallNum(0)
+{
+}
+
+TextBatch::~TextBatch()
+{
+    if(m_vertexArray)
+    {
+        glDeleteVertexArrays(1, &m_vertexArray);
+        glDeleteBuffers(1, &m_vertexBuffer);
+        glDeleteBuffers(1, &m_indexBuffer);
+    }
+}
+
+void TextBatch::initializeGL()
+{
+    initializeOpenGLFunctions();
+    CHECK_OPENGL_ES_ERROR(glGenVertexArrays(1, &m_vertexArray));
+    CHECK_OPENGL_ES_ERROR(glGenBuffers(1, &m_vertexBuffer));
+    CHECK_OPENGL_ES_ERROR(glGenBuffers(1, &m_indexBuffer));
+    CHECK_OPENGL_ES_ERROR(glBindVertexArray(m_vertexArray));
+    CHECK_OPENGL_ES_ERROR(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer));
+    CHECK_OPENGL_ES_ERROR(glEnableVertexAttribArray(0));
+    CHECK_OPENGL_ES_ERROR(glEnableVertexAttribArray(1));
+    CHECK_OPENGL_ES_ERROR(glBindVertexArray(0));
+}
+
+void TextBatch::clear()
+{
+    m_vertices.clear();
+}
+
+void TextBatch::addText(const std::u32string& text, float x, float y, float z, float scale)
+{
+    if(m_layoutCache)
+    {
+        //with subpixel variants the run depends on the phase of the pen, it is laid out from the
+        //phase and moved by whole pixels
+        float phaseX = 0.0f;
+        if(m_font->subpixelPositions() > 1)
+        {
+            unsigned int phase;
+            float pixel = m_font->subpixelPen(x / scale, phase);
+            phaseX = (float)phase / m_font->subpixelPositions() * scale;
+            x = pixel * scale;
+        }
+        addRun(m_layoutCache->layout(m_font, text, scale, phaseX), x, y, z);
+        return;
+    }
+    size_t first = m_vertices.size();
+    m_vertices.resize(first + text.size() * 4);
+    size_t glyphNum = m_font->layoutText(text.data(), text.size(), x, y, z, scale, m_vertices.data() + first);
+    m_vertices.resize(first + glyphNum * 4);
+}
+
+void TextBatch::addRun(const TextRun& run, float x, float y, float z)
+{
+    size_t first = m_vertices.size();
+    m_vertices.resize(first + run.glyphNum * 4);
+    TextVertex* vertices = m_vertices.data() + first;
+    for(size_t i = 0; i < run.glyphNum * 4; i++)
+    {
+        vertices[i] = run.vertices[i];
+        vertices[i].x += x;
+        vertices[i].y += y;
+        vertices[i].z += z;
+    }
+}
+
+void TextBatch::addGlyph(unsigned int unicode, const float corners[4][3])
+{
+    TextureCoord coord = m_font->textureCoord(unicode);
+    const float u[4] = {coord.left, coord.left, coord.right, coord.right};
+    const float v[4] = {coord.top, coord.bottom, coord.top, coord.bottom};
+    for(int i = 0; i < 4; i++)
+    {
+        m_vertices.push_back({corners[i][0], corners[i][1], corners[i][2], u[i], v[i], (float)coord.page});
+    }
+}
+
+void TextBatch::reserveIndices(size_t glyphNum)
+{
+    if(glyphNum <= m_indexGlyphNum)
+    {
+        return;
+    }
+    m_indexGlyphNum = std::min((size_t)MAX_BATCH_GLYPH_NUM, std::max(glyphNum, m_indexGlyphNum * 2));
+    std::vector<GLushort> indices(m_indexGlyphNum * 6);
+    for(size_t i = 0; i < m_indexGlyphNum; i++)
+    {
+        GLushort first = i * 4;
+        indices[i * 6 + 0] = first;
+        indices[i * 6 + 1] = first + 1;
+        indices[i * 6 + 2] = first + 2;
+        indices[i * 6 + 3] = first + 2;
+        indices[i * 6 + 4] = first + 1;
+        indices[i * 6 + 5] = first + 3;
+    }
+    CHECK_OPENGL_ES_ERROR(glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), indices.data(), GL_STATIC_DRAW));
+}
+
+void TextBatch::draw()
+{
+    m_drawCallNum = 0;
+    if(m_vertices.empty())
+    {
+        return;
+    }
+    size_t glyphNum = m_vertices.size() / 4;
+    size_t size = m_vertices.size() * sizeof(TextVertex);
+    CHECK_OPENGL_ES_ERROR(glBindVertexArray(m_vertexArray));
+    reserveIndices(glyphNum);
+
+    //every draw() appends behind the previous one, so the GPU may still read earlier ranges while
+    //this one is written unsynchronized; a full buffer is orphaned and the driver hands out new storage
+    CHECK_OPENGL_ES_ERROR(glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer));
+    if(m_vertexBufferOffset + size > m_vertexBufferSize)
+    {
+        m_vertexBufferSize = std::max(m_vertexBufferSize, (size_t)MIN_VERTEX_BUFFER_SIZE);
+        while(m_vertexBufferSize < size)
+        {
+            m_vertexBufferSize *= 2;
+        }
+        CHECK_OPENGL_ES_ERROR(glBufferData(GL_ARRAY_BUFFER, m_vertexBufferSize, nullptr, GL_STREAM_DRAW));
+        m_vertexBufferOffset = 0;
+    }
+    void* mapped = glMapBufferRange(GL_ARRAY_BUFFER, m_vertexBufferOffset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if(mapped)
+    {
+        memcpy(mapped, m_vertices.data(), size);
+        CHECK_OPENGL_ES_ERROR(glUnmapBuffer(GL_ARRAY_BUFFER));
+    }
+    else
+    {
+        CHECK_OPENGL_ES_ERROR(glBufferSubData(GL_ARRAY_BUFFER, m_vertexBufferOffset, size, m_vertices.data()));
+    }
+
+    //GLES 3.0 has no base vertex, batches beyond the index range restart the attributes instead
+    for(size_t first = 0; first < glyphNum; first += MAX_BATCH_GLYPH_NUM)
+    {
+        size_t count = std::min(glyphNum - first, (size_t)MAX_BATCH_GLYPH_NUM);
+        size_t offset = m_vertexBufferOffset + first * 4 * sizeof(TextVertex);
+        CHECK_OPENGL_ES_ERROR(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (const void *)(offset + offsetof(TextVertex, x))));
+        CHECK_OPENGL_ES_ERROR(glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (const void *)(offset + offsetof(TextVertex, u))));
+        CHECK_OPENGL_ES_ERROR(glDrawElements(GL_TRIANGLES, count * 6, GL_UNSIGNED_SHORT, (const void *)0));
+        m_drawCallNum++;
+    }
+    m_vertexBufferOffset += size;
+    CHECK_OPENGL_ES_ERROR(glBindVertexArray(0));
+}
+
+size_t TextBatch::glyphNum() const
+{
+    return m_vertices.size() / 4;
+}
+
+unsigned int TextBatch::drawCallNum() const
+{
+    return m_drawCallNum;
+}
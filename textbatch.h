@@ -0,0 +1,52 @@
+#ifndef TEXTBATCH_H
+#define TEXTBATCH_H
+
+#include <QOpenGLExtraFunctions>
+#include <string>
+#include <vector>
+#include "texturefont.h"
+#include "textlayoutcache.h"
+
+//collects the glyph quads of one TextureFont, interleaved in a single vertex array, and draws
+//all of them with one glDrawElements from a streaming vertex buffer and a shared index buffer
+class TextBatch final : protected QOpenGLExtraFunctions
+{
+public:
+    //with a layoutCache addText() reuses the vertices of texts added in earlier frames
+    explicit TextBatch(const TextureFont* font, TextLayoutCache* layoutCache = nullptr);
+    ~TextBatch();  //the context of initializeGL() has to be current
+
+    void initializeGL();
+    void clear();
+    //lays text out left to right from the pen position (x, y) on the baseline, y grows upwards;
+    //scale converts atlas pixels to the units of x and y
+    void addText(const std::u32string& text, float x, float y, float z, float scale);
+    //a run laid out at the pen origin, e.g. by a TextLayoutCache, moved to (x, y, z)
+    void addRun(const TextRun& run, float x, float y, float z);
+    //maps the glyph of unicode onto a quad, corners in the order top left, bottom left, top right, bottom right
+    void addGlyph(unsigned int unicode, const float corners[4][3]);
+    //position at attribute location 0, texture coordinate and page at location 1
+    void draw();
+    size_t glyphNum() const;
+    unsigned int drawCallNum() const;  //of the last draw(), one per MAX_BATCH_GLYPH_NUM glyphs
+
+private:
+    TextBatch& operator=(const TextBatch&) = delete;
+    TextBatch(const TextBatch&) = delete;
+
+    void reserveIndices(size_t glyphNum);
+
+private:
+    const TextureFont* m_font;
+    TextLayoutCache* m_layoutCache;
+    std::vector<TextVertex> m_vertices;
+    GLuint m_vertexArray;
+    GLuint m_vertexBuffer;
+    GLuint m_indexBuffer;
+    size_t m_vertexBufferSize;    //in byte
+    size_t m_vertexBufferOffset;  //in byte, where the next draw() writes
+    size_t m_indexGlyphNum;
+    unsigned int m_drawCallNum;
+};
+
+#endif // TEXTBATCH_H
@@ -0,0 +1,754 @@
+#include <QGuiApplication>
+#include <QSurfaceFormat>
+#include <QOpenGLContext>
+#include <QOffscreenSurface>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLExtraFunctions>
+#include <QElapsedTimer>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <atomic>
+#include <new>
+#include <string>
+#include <vector>
+#include "texturefont.h"
+#include "textbatch.h"
+#include "textlayoutcache.h"
+#include "atlasuploader.h"
+#include "framestats.h"
+#include "textcompositor.h"
+
+#define BENCH_WIDTH 1280
+#define BENCH_HEIGHT 720
+#define BENCH_LINE_LENGTH 80
+#define BENCH_WARMUP_FRAMES 10
+#define BENCH_UPLOAD_BYTES_PER_FRAME (4 * 1024 * 1024)
+
+//every operator new of the process, --extract takes the difference around each pass
+static std::atomic<unsigned long long> allocationNum(0);
+
+void* operator new(size_t size)
+{
+    allocationNum++;
+    void* memory = malloc(size ? size : 1);
+    if(!memory)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+
+static void printUsage()
+{
+    fprintf(stderr,
+            "usage: textbench <font file> [options]\n"
+            "  --glyphs <n>   thousand glyphs per frame, default 10\n"
+            "  --frames <n>   measured frames, default 300\n"
+            "  --pt <n>       default 16\n"
+            "  --dynamic      rasterize glyphs on first use instead of baking the face\n"
+            "  --sdf          signed distance field atlas\n"
+            "  --format <f>   coverage8, coverage4 or lcd atlas, default coverage8\n"
+            "  --gamma <g>    coverage gamma applied while baking, default 1\n"
+            "  --eac          sample the coverage8 atlas from an EAC R11 texture encoded while baking\n"
+            "  --no-cache     lay every line out every frame instead of using a TextLayoutCache\n"
+            "  --cpu [n]      blend into an RGBA8 buffer with a TextCompositor on n threads instead, default 1\n"
+            "  --layout       only lay the lines out, with layoutText() and with a lookup per character\n"
+            "  --extract      only copy the glyph images of the lines out of the atlas, counting allocations\n"
+            "  --upload       only load the baked font from a raw and a compressed .tf file and upload it, warm and\n"
+            "                 cold from the page cache; writes textbench-raw.tf and textbench-compressed.tf\n"
+            "Renders into an offscreen framebuffer, by default on Mesa's llvmpipe; set QT_QPA_PLATFORM\n"
+            "or LIBGL_ALWAYS_SOFTWARE to use another platform or driver\n");
+}
+
+static bool parseAtlasFormat(const char* name, AtlasFormat& format)
+{
+    const AtlasFormat formats[3] = {AtlasFormat::Coverage8, AtlasFormat::Coverage4, AtlasFormat::LCD};
+    for(int i = 0; i < 3; i++)
+    {
+        if(!strcmp(name, atlasFormatName(formats[i])))
+        {
+            format = formats[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+//the memory the atlas takes, in the TextureFont and the same again in the texture
+static size_t atlasByteNum(const TextureFont& font)
+{
+    return font.textureRowBytes() * font.textureHeight() * font.pageNum();
+}
+
+static size_t textureByteNum(const TextureFont& font)
+{
+    return font.eacTexture() ? font.eacPageBytes() * font.pageNum() : atlasByteNum(font);
+}
+
+static void printSummary(const char* name, const FrameTimeSummary& summary)
+{
+    printf("%-6s avg %8.3f ms  p50 %8.3f ms  p99 %8.3f ms  max %8.3f ms\n", name, summary.average, summary.p50, summary.p99, summary.max);
+}
+
+//distinct lines, so every one is a run of its own in the layout cache
+static std::vector<std::u32string> benchLines(unsigned int glyphThousands)
+{
+    const char* words = "The quick brown fox jumps over the lazy dog. Pack my box with five dozen liquor jugs! 0123456789 ";
+    size_t wordLength = strlen(words);
+    size_t lineNum = ((size_t)glyphThousands * 1000 + BENCH_LINE_LENGTH - 1) / BENCH_LINE_LENGTH;
+    std::vector<std::u32string> lines(lineNum);
+    for(size_t i = 0; i < lineNum; i++)
+    {
+        char prefix[32];
+        snprintf(prefix, sizeof(prefix), "%zu: ", i);
+        std::string line(prefix);
+        for(size_t j = i; line.size() < BENCH_LINE_LENGTH; j++)
+        {
+            line += words[j % wordLength];
+        }
+        lines[i].assign(line.begin(), line.end());
+    }
+    return lines;
+}
+
+//the same frames without a GL context, blended on the CPU; cpu and frame time are the same
+static int runCompositorBench(const char* fontFileName, unsigned int pt, const TextureFontOptions& fontOptions,
+                              unsigned int glyphThousands, unsigned int frameNum, unsigned int threadNum)
+{
+    QElapsedTimer buildTimer;
+    buildTimer.start();
+    TextureFont font(fontFileName, pt, 96, 96, fontOptions);
+    printf("font built in %.1f ms, %u pages of %ux%u %s (%.1f KB), %s blend kernels\n", buildTimer.nsecsElapsed() / 1e6,
+           font.pageNum(), font.textureWidth(), font.textureHeight(), atlasFormatName(font.atlasFormat()),
+           atlasByteNum(font) / 1024.0, blendKernelName());
+
+    std::vector<std::u32string> lines = benchLines(glyphThousands);
+    float lineHeight = font.fontMetrics().lineHeight;
+    size_t linesPerColumn = std::max((size_t)1, (size_t)(BENCH_HEIGHT / lineHeight));
+    std::vector<unsigned char> pixels((size_t)BENCH_WIDTH * BENCH_HEIGHT * 4);
+    PixelBuffer target{pixels.data(), BENCH_WIDTH, BENCH_HEIGHT, BENCH_WIDTH * 4, PixelFormat::RGBA8};
+    TextCompositor compositor(&font, threadNum);
+
+    FrameStatsHistory history(frameNum);
+    QElapsedTimer frameTimer;
+    for(unsigned int frame = 0; frame < BENCH_WARMUP_FRAMES + frameNum; frame++)
+    {
+        FrameStats stats{0.0, 0.0, 0, 0, 0, 0, 0, 0, 0};
+        GlyphCacheStats glyphStats = font.glyphCacheStats();
+        frameTimer.start();
+
+        for(int pass = 0; pass < 2; pass++)
+        {
+            compositor.clear();
+            for(size_t i = 0; i < lines.size(); i++)
+            {
+                compositor.addText(lines[i], 0.0f, (i % linesPerColumn + 1) * lineHeight, TextColor{0, 0, 0, 255});
+            }
+            if(font.takeEvictedCharacters().empty())
+            {
+                break;
+            }
+        }
+        font.takeDirtyRects();  //nothing to upload, the compositor reads the atlas itself
+        memset(pixels.data(), 255, pixels.size());
+        compositor.draw(target);
+        stats.cpuTime = frameTimer.nsecsElapsed() / 1e6;
+        stats.frameTime = stats.cpuTime;
+
+        stats.glyphNum = compositor.glyphNum();
+        stats.glyphCacheHits = font.glyphCacheStats().hits - glyphStats.hits;
+        stats.glyphCacheMisses = font.glyphCacheStats().misses - glyphStats.misses;
+        if(frame >= BENCH_WARMUP_FRAMES)
+        {
+            history.add(stats);
+        }
+    }
+
+    FrameStats total = history.total();
+    printf("%zu glyphs in %zu lines, %u frames after %u warmup frames, %s %s atlas%s, %u threads\n",
+           total.glyphNum / history.frameNum(), lines.size(), frameNum, BENCH_WARMUP_FRAMES,
+           fontOptions.dynamicAtlas ? "dynamic" : "static", atlasFormatName(font.atlasFormat()),
+           fontOptions.signedDistanceField ? ", distance fields" : "", threadNum);
+    printSummary("frame", history.frameTimeSummary());
+    printf("%llu glyphs rasterized\n", total.glyphCacheMisses);
+    return 0;
+}
+
+//the path layoutText() replaced: characterInfo(), textureCoord() and kerning() per character, each
+//resolving it again, and the vertices appended one by one
+static void layoutPerCharacter(const TextureFont& font, const std::u32string& text, float x, float y, std::vector<TextVertex>& vertices)
+{
+    for(auto iter = text.begin(); iter != text.end(); iter++)
+    {
+        if(iter != text.begin())
+        {
+            x += font.kerning(*(iter - 1), *iter);
+        }
+        CharacterInfo info = font.characterInfo(*iter);
+        if(info.width != 0 && info.height != 0)
+        {
+            TextureCoord coord = font.textureCoord(*iter);
+            float left = x + (int)info.bitmap_left;
+            float top = y + (int)info.bitmap_top;
+            float right = left + info.width;
+            float bottom = top - info.height;
+            vertices.push_back({left, top, 0.0f, coord.left, coord.top, (float)coord.page});
+            vertices.push_back({left, bottom, 0.0f, coord.left, coord.bottom, (float)coord.page});
+            vertices.push_back({right, top, 0.0f, coord.right, coord.top, (float)coord.page});
+            vertices.push_back({right, bottom, 0.0f, coord.right, coord.bottom, (float)coord.page});
+        }
+        x += info.advance / 64.0f;
+    }
+}
+
+//layout alone, no GL context: the same lines every frame through both paths, the vertex buffers are reused
+static int runLayoutBench(const char* fontFileName, unsigned int pt, const TextureFontOptions& fontOptions,
+                          unsigned int glyphThousands, unsigned int frameNum)
+{
+    TextureFont font(fontFileName, pt, 96, 96, fontOptions);
+    font.waitForBuild();
+    std::vector<std::u32string> lines = benchLines(glyphThousands);
+    size_t characterNum = 0;
+    for(size_t i = 0; i < lines.size(); i++)
+    {
+        characterNum += lines[i].size();
+    }
+    float lineHeight = font.fontMetrics().lineHeight;
+    std::vector<TextVertex> vertices(characterNum * 4);
+    std::vector<TextVertex> characterVertices;
+    characterVertices.reserve(characterNum * 4);
+
+    FrameStatsHistory textHistory(frameNum);
+    FrameStatsHistory characterHistory(frameNum);
+    QElapsedTimer timer;
+    size_t glyphNum = 0;
+    for(unsigned int frame = 0; frame < BENCH_WARMUP_FRAMES + frameNum; frame++)
+    {
+        FrameStats stats{0.0, 0.0, 0, 0, 0, 0, 0, 0, 0};
+        timer.start();
+        glyphNum = 0;
+        for(size_t i = 0; i < lines.size(); i++)
+        {
+            glyphNum += font.layoutText(lines[i].data(), lines[i].size(), 0.0f, i * lineHeight, 0.0f, 1.0f, vertices.data() + glyphNum * 4);
+        }
+        stats.cpuTime = timer.nsecsElapsed() / 1e6;
+        stats.frameTime = stats.cpuTime;
+        if(frame >= BENCH_WARMUP_FRAMES)
+        {
+            textHistory.add(stats);
+        }
+
+        timer.start();
+        characterVertices.clear();
+        for(size_t i = 0; i < lines.size(); i++)
+        {
+            layoutPerCharacter(font, lines[i], 0.0f, i * lineHeight, characterVertices);
+        }
+        stats.cpuTime = timer.nsecsElapsed() / 1e6;
+        stats.frameTime = stats.cpuTime;
+        if(frame >= BENCH_WARMUP_FRAMES)
+        {
+            characterHistory.add(stats);
+        }
+    }
+
+    FrameTimeSummary text = textHistory.frameTimeSummary();
+    FrameTimeSummary character = characterHistory.frameTimeSummary();
+    printf("%zu characters, %zu glyphs in %zu lines, %u frames after %u warmup frames, %s %s atlas, %s layout kernels\n",
+           characterNum, glyphNum, lines.size(), frameNum, BENCH_WARMUP_FRAMES, fontOptions.dynamicAtlas ? "dynamic" : "static",
+           atlasFormatName(font.atlasFormat()), layoutKernelName());
+    printSummary("text", text);
+    printSummary("char", character);
+    printf("layoutText %.1f Mchar/s, per character %.1f Mchar/s at p50, %.2fx\n", characterNum / text.p50 / 1e3,
+           characterNum / character.p50 / 1e3, character.p50 / text.p50);
+    return 0;
+}
+
+//reads every pixel so the copies and views can't be skipped
+static unsigned int imageChecksum(const CharacterImageView& view)
+{
+    unsigned int sum = 0;
+    size_t rowBytes = atlasRowBytes(view.format, view.width);
+    for(unsigned int i = 0; i < view.height; i++)
+    {
+        const unsigned char* row = view.pixels + (size_t)i * view.stride;
+        for(size_t j = 0; j < rowBytes; j++)
+        {
+            sum += row[j];
+        }
+    }
+    return sum;
+}
+
+//glyph extraction alone, no GL context: the characters of the lines every frame through characterImage(),
+//characterImageView() and characterImage() into an arena. The last two must not allocate after warmup
+static int runExtractBench(const char* fontFileName, unsigned int pt, const TextureFontOptions& fontOptions,
+                           unsigned int glyphThousands, unsigned int frameNum)
+{
+    TextureFont font(fontFileName, pt, 96, 96, fontOptions);
+    font.waitForBuild();
+    std::vector<std::u32string> lines = benchLines(glyphThousands);
+    size_t characterNum = 0;
+    for(size_t i = 0; i < lines.size(); i++)
+    {
+        characterNum += lines[i].size();
+    }
+    CharacterImageArena arena;
+
+    const char* names[3] = {"copy", "view", "arena"};
+    FrameStatsHistory histories[3] = {FrameStatsHistory(frameNum), FrameStatsHistory(frameNum), FrameStatsHistory(frameNum)};
+    unsigned long long allocations[3] = {0, 0, 0};
+    unsigned int checksums[3] = {0, 0, 0};
+    QElapsedTimer timer;
+    for(unsigned int frame = 0; frame < BENCH_WARMUP_FRAMES + frameNum; frame++)
+    {
+        for(int pass = 0; pass < 3; pass++)
+        {
+            FrameStats stats{0.0, 0.0, 0, 0, 0, 0, 0, 0, 0};
+            unsigned long long allocationStart = allocationNum;
+            unsigned int checksum = 0;
+            timer.start();
+            if(pass == 2)
+            {
+                arena.clear();
+            }
+            for(size_t i = 0; i < lines.size(); i++)
+            {
+                for(auto iter = lines[i].begin(); iter != lines[i].end(); iter++)
+                {
+                    if(pass == 0)
+                    {
+                        CharacterImage image = font.characterImage(*iter);
+                        checksum += imageChecksum(CharacterImageView{image.image(), image.width(), image.height(),
+                                                                     (unsigned int)atlasRowBytes(image.format(), image.width()),
+                                                                     image.bitmap_left(), image.bitmap_top(), image.format()});
+                    }
+                    else if(pass == 1)
+                    {
+                        checksum += imageChecksum(font.characterImageView(*iter));
+                    }
+                    else
+                    {
+                        checksum += imageChecksum(font.characterImage(*iter, arena));
+                    }
+                }
+            }
+            stats.cpuTime = timer.nsecsElapsed() / 1e6;
+            stats.frameTime = stats.cpuTime;
+            if(frame >= BENCH_WARMUP_FRAMES)
+            {
+                histories[pass].add(stats);
+                allocations[pass] += allocationNum - allocationStart;
+            }
+            checksums[pass] = checksum;
+        }
+    }
+
+    printf("%zu characters in %zu lines, %u frames after %u warmup frames, %s %s atlas\n",
+           characterNum, lines.size(), frameNum, BENCH_WARMUP_FRAMES, fontOptions.dynamicAtlas ? "dynamic" : "static",
+           atlasFormatName(font.atlasFormat()));
+    int result = 0;
+    for(int pass = 0; pass < 3; pass++)
+    {
+        FrameTimeSummary summary = histories[pass].frameTimeSummary();
+        printSummary(names[pass], summary);
+        printf("%-6s %.1f Mchar/s at p50, %.3f allocations per character\n", names[pass], characterNum / summary.p50 / 1e3,
+               (double)allocations[pass] / ((double)characterNum * frameNum));
+        if(pass != 0 && allocations[pass] != 0)
+        {
+            fprintf(stderr, "[Error] %s allocated %llu times after warmup\n", names[pass], allocations[pass]);
+            result = 1;
+        }
+        if(checksums[pass] != checksums[0])
+        {
+            fprintf(stderr, "[Error] %s doesn't return the pixels of characterImage()\n", names[pass]);
+            result = 1;
+        }
+    }
+    printf("arena  %zu bytes allocated, %zu used per frame\n", arena.byteSize(), arena.usedByteSize());
+    return result;
+}
+
+//the next load reads the file from the disk instead of the page cache
+static void evictFromPageCache(const char* fileName)
+{
+    int file = open(fileName, O_RDONLY);
+    if(file < 0)
+    {
+        return;
+    }
+    fdatasync(file);
+    posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED);
+    close(file);
+}
+
+//load to GPU latency of a texture font file: the constructor, then every page through the AtlasUploader
+//until glFinish() returns. A compressed file is decoded by the first upload(), when it reads texture()
+static int runUploadBench(QOpenGLExtraFunctions* gl, const char* fontFileName, unsigned int pt,
+                          const TextureFontOptions& fontOptions, unsigned int frameNum)
+{
+    const char* fileNames[2] = {"textbench-raw.tf", "textbench-compressed.tf"};
+    {
+        TextureFont font(fontFileName, pt, 96, 96, fontOptions);
+        font.waitForBuild();
+        font.saveToTextureFile(fileNames[0], false);
+        font.saveToTextureFile(fileNames[1], true);
+        printf("%u pages of %ux%u %s%s (%.1f KB texture)\n", font.pageNum(), font.textureWidth(), font.textureHeight(),
+               atlasFormatName(font.atlasFormat()), font.eacTexture() ? " as EAC R11" : "", textureByteNum(font) / 1024.0);
+    }
+
+    AtlasUploader uploader;
+    uploader.initializeGL();
+    GLuint texture;
+    gl->glGenTextures(1, &texture);
+    QElapsedTimer timer;
+    for(int compressed = 0; compressed < 2; compressed++)
+    {
+        FILE* file = fopen(fileNames[compressed], "rb");
+        long fileSize = 0;
+        if(file)
+        {
+            fseek(file, 0, SEEK_END);
+            fileSize = ftell(file);
+            fclose(file);
+        }
+        for(int cold = 0; cold < 2; cold++)
+        {
+            //cpu time is the constructor, frame time until the texture is complete on the GPU
+            FrameStatsHistory history(frameNum);
+            for(unsigned int frame = 0; frame < BENCH_WARMUP_FRAMES + frameNum; frame++)
+            {
+                if(cold)
+                {
+                    evictFromPageCache(fileNames[compressed]);
+                }
+                FrameStats stats{0.0, 0.0, 0, 0, 0, 0, 0, 0, 0};
+                timer.start();
+                TextureFont font(fileNames[compressed]);
+                stats.cpuTime = timer.nsecsElapsed() / 1e6;
+                uploader.allocate(&font, texture);
+                uploader.enqueuePages(&font);
+                while(uploader.pendingByteNum() != 0)
+                {
+                    stats.uploadedByteNum += uploader.upload(&font, texture, BENCH_UPLOAD_BYTES_PER_FRAME);
+                }
+                gl->glFinish();
+                stats.frameTime = timer.nsecsElapsed() / 1e6;
+                if(frame >= BENCH_WARMUP_FRAMES)
+                {
+                    history.add(stats);
+                }
+            }
+            char name[32];
+            snprintf(name, sizeof(name), "%s %s", compressed ? "compressed" : "raw", cold ? "cold" : "warm");
+            FrameTimeSummary load = history.cpuTimeSummary();
+            FrameTimeSummary total = history.frameTimeSummary();
+            printf("%-15s %8.1f KB file, load p50 %8.3f ms, load and upload p50 %8.3f ms p99 %8.3f ms, %.1f KB uploaded\n",
+                   name, fileSize / 1024.0, load.p50, total.p50, total.p99, history.total().uploadedByteNum / 1024.0 / frameNum);
+        }
+    }
+    gl->glDeleteTextures(1, &texture);
+    remove(fileNames[0]);
+    remove(fileNames[1]);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char* fontFileName = nullptr;
+    unsigned int glyphThousands = 10;
+    unsigned int frameNum = 300;
+    unsigned int pt = 16;
+    bool useLayoutCache = true;
+    unsigned int compositorThreadNum = 0;  //0 draws with OpenGL
+    bool layoutOnly = false;
+    bool extractOnly = false;
+    bool uploadOnly = false;
+    TextureFontOptions fontOptions;
+    fontOptions.threadNum = 0;
+    for(int i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "--glyphs") && i + 1 < argc)
+        {
+            glyphThousands = atoi(argv[++i]);
+        }
+        else if(!strcmp(argv[i], "--frames") && i + 1 < argc)
+        {
+            frameNum = atoi(argv[++i]);
+        }
+        else if(!strcmp(argv[i], "--pt") && i + 1 < argc)
+        {
+            pt = atoi(argv[++i]);
+        }
+        else if(!strcmp(argv[i], "--dynamic"))
+        {
+            fontOptions.dynamicAtlas = true;
+        }
+        else if(!strcmp(argv[i], "--sdf"))
+        {
+            fontOptions.signedDistanceField = true;
+        }
+        else if(!strcmp(argv[i], "--format") && i + 1 < argc)
+        {
+            if(!parseAtlasFormat(argv[++i], fontOptions.atlasFormat))
+            {
+                printUsage();
+                return 1;
+            }
+        }
+        else if(!strcmp(argv[i], "--gamma") && i + 1 < argc)
+        {
+            fontOptions.coverageGamma = atof(argv[++i]);
+        }
+        else if(!strcmp(argv[i], "--eac"))
+        {
+            fontOptions.eacTexture = true;
+        }
+        else if(!strcmp(argv[i], "--no-cache"))
+        {
+            useLayoutCache = false;
+        }
+        else if(!strcmp(argv[i], "--layout"))
+        {
+            layoutOnly = true;
+        }
+        else if(!strcmp(argv[i], "--extract"))
+        {
+            extractOnly = true;
+        }
+        else if(!strcmp(argv[i], "--upload"))
+        {
+            uploadOnly = true;
+        }
+        else if(!strcmp(argv[i], "--cpu"))
+        {
+            compositorThreadNum = 1;
+            if(i + 1 < argc && atoi(argv[i + 1]) > 0)
+            {
+                compositorThreadNum = atoi(argv[++i]);
+            }
+        }
+        else if(argv[i][0] != '-' && !fontFileName)
+        {
+            fontFileName = argv[i];
+        }
+        else
+        {
+            printUsage();
+            return 1;
+        }
+    }
+    if(!fontFileName || glyphThousands == 0 || frameNum == 0 || pt == 0)
+    {
+        printUsage();
+        return 1;
+    }
+    if(layoutOnly)
+    {
+        return runLayoutBench(fontFileName, pt, fontOptions, glyphThousands, frameNum);
+    }
+    if(extractOnly)
+    {
+        return runExtractBench(fontFileName, pt, fontOptions, glyphThousands, frameNum);
+    }
+    if(compositorThreadNum != 0)
+    {
+        return runCompositorBench(fontFileName, pt, fontOptions, glyphThousands, frameNum, compositorThreadNum);
+    }
+
+    //headless on the software rasterizer unless asked otherwise
+    if(!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+    {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    if(!qEnvironmentVariableIsSet("LIBGL_ALWAYS_SOFTWARE"))
+    {
+        qputenv("LIBGL_ALWAYS_SOFTWARE", "1");
+    }
+    QGuiApplication app(argc, argv);
+
+    QSurfaceFormat format;
+    format.setRenderableType(QSurfaceFormat::OpenGLES);
+    format.setProfile(QSurfaceFormat::NoProfile);
+    format.setVersion(3, 0);
+    QOpenGLContext context;
+    context.setFormat(format);
+    if(!context.create())
+    {
+        fprintf(stderr, "[Error] cannot create an OpenGL ES 3.0 context\n");
+        return 1;
+    }
+    QOffscreenSurface surface;
+    surface.setFormat(context.format());
+    surface.create();
+    if(!context.makeCurrent(&surface))
+    {
+        fprintf(stderr, "[Error] cannot make the context current on an offscreen surface\n");
+        return 1;
+    }
+    QOpenGLExtraFunctions* gl = context.extraFunctions();
+    printf("%s / %s\n", (const char *)gl->glGetString(GL_VERSION), (const char *)gl->glGetString(GL_RENDERER));
+    if(uploadOnly)
+    {
+        return runUploadBench(gl, fontFileName, pt, fontOptions, frameNum);
+    }
+
+    {
+        QOpenGLFramebufferObject framebuffer(BENCH_WIDTH, BENCH_HEIGHT);
+        framebuffer.bind();
+        gl->glViewport(0, 0, BENCH_WIDTH, BENCH_HEIGHT);
+
+        QElapsedTimer buildTimer;
+        buildTimer.start();
+        TextureFont font(fontFileName, pt, 96, 96, fontOptions);
+        printf("font built in %.1f ms, %u pages of %ux%u %s%s (%.1f KB texture)\n", buildTimer.nsecsElapsed() / 1e6, font.pageNum(),
+               font.textureWidth(), font.textureHeight(), atlasFormatName(font.atlasFormat()), font.eacTexture() ? " as EAC R11" : "",
+               textureByteNum(font) / 1024.0);
+
+        //the frame time compares the fragment cost of the formats: coverage4 fetches and unpacks the
+        //nibble with integer instructions, lcd fetches RGB and blends with a constant color, distance
+        //fields add fwidth and smoothstep
+        const char* fragmentShader = ":/fragment_shader/simplefrag.fsh";
+        if(font.signedDistanceField())
+        {
+            fragmentShader = ":/fragment_shader/sdffrag.fsh";
+        }
+        else if(font.atlasFormat() == AtlasFormat::Coverage4)
+        {
+            fragmentShader = ":/fragment_shader/coverage4frag.fsh";
+        }
+        else if(font.atlasFormat() == AtlasFormat::LCD)
+        {
+            fragmentShader = ":/fragment_shader/lcdfrag.fsh";
+        }
+        QOpenGLShaderProgram program;
+        program.addShaderFromSourceFile(QOpenGLShader::Vertex, ":/vertex_shader/simplevertex.vsh");
+        program.addShaderFromSourceFile(QOpenGLShader::Fragment, fragmentShader);
+        if(!program.link())
+        {
+            fprintf(stderr, "[Error] the shaders don't link\n");
+            return 1;
+        }
+
+        std::vector<std::u32string> lines = benchLines(glyphThousands);
+        size_t lineNum = lines.size();
+        //the lines are stacked down the framebuffer and wrap around to the top
+        float scale = 1.0f;
+        float lineHeight = font.fontMetrics().lineHeight * scale;
+        size_t linesPerColumn = std::max((size_t)1, (size_t)(BENCH_HEIGHT / lineHeight));
+
+        TextLayoutCache layoutCache;
+        TextBatch batch(&font, useLayoutCache ? &layoutCache : nullptr);
+        batch.initializeGL();
+        AtlasUploader uploader;
+        uploader.initializeGL();
+        GLuint texture;
+        gl->glGenTextures(1, &texture);
+        gl->glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        GLint filter = font.signedDistanceField() ? GL_LINEAR : GL_NEAREST;
+        gl->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, filter);
+        gl->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, filter);
+        unsigned int texturePageNum = 0;
+
+        program.bind();
+        program.setUniformValue("s_tex0", 0);
+        gl->glUniform4f(program.uniformLocation("u_transform"), 2.0f / BENCH_WIDTH, 2.0f / BENCH_HEIGHT, -1.0f, -1.0f);
+        if(font.atlasFormat() != AtlasFormat::Coverage8)
+        {
+            gl->glUniform2f(program.uniformLocation("u_atlasSize"), font.textureWidth() - 1.0f, font.textureHeight() - 1.0f);
+        }
+        gl->glEnable(GL_BLEND);
+        if(font.atlasFormat() == AtlasFormat::LCD)
+        {
+            gl->glBlendColor(0.0f, 0.0f, 0.0f, 1.0f);
+            gl->glBlendFunc(GL_CONSTANT_COLOR, GL_ONE_MINUS_SRC_COLOR);
+        }
+        else
+        {
+            gl->glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        }
+        gl->glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+
+        FrameStatsHistory history(frameNum);
+        QElapsedTimer frameTimer;
+        for(unsigned int frame = 0; frame < BENCH_WARMUP_FRAMES + frameNum; frame++)
+        {
+            FrameStats stats{0.0, 0.0, 0, 0, 0, 0, 0, 0, 0};
+            TextLayoutCacheStats layoutStats = layoutCache.stats();
+            GlyphCacheStats glyphStats = font.glyphCacheStats();
+            frameTimer.start();
+
+            for(int pass = 0; pass < 2; pass++)
+            {
+                batch.clear();
+                for(size_t i = 0; i < lineNum; i++)
+                {
+                    float y = BENCH_HEIGHT - (i % linesPerColumn + 1) * lineHeight;
+                    batch.addText(lines[i], 0.0f, y, 0.0f, scale);
+                }
+                if(font.takeEvictedCharacters().empty())
+                {
+                    break;
+                }
+            }
+            std::vector<DirtyRect> dirtyRects = font.takeDirtyRects();
+            if(texturePageNum != font.pageNum())
+            {
+                uploader.allocate(&font, texture);
+                texturePageNum = font.pageNum();
+                uploader.clear();
+                uploader.enqueuePages(&font);
+            }
+            else
+            {
+                uploader.enqueue(dirtyRects);
+            }
+            stats.uploadedByteNum = uploader.upload(&font, texture, BENCH_UPLOAD_BYTES_PER_FRAME);
+            gl->glActiveTexture(GL_TEXTURE0);
+            gl->glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+            gl->glClear(GL_COLOR_BUFFER_BIT);
+            batch.draw();
+            stats.cpuTime = frameTimer.nsecsElapsed() / 1e6;
+            gl->glFinish();
+            stats.frameTime = frameTimer.nsecsElapsed() / 1e6;
+
+            stats.drawCallNum = batch.drawCallNum();
+            stats.glyphNum = batch.glyphNum();
+            stats.layoutCacheHits = layoutCache.stats().hits - layoutStats.hits;
+            stats.layoutCacheMisses = layoutCache.stats().misses - layoutStats.misses;
+            stats.glyphCacheHits = font.glyphCacheStats().hits - glyphStats.hits;
+            stats.glyphCacheMisses = font.glyphCacheStats().misses - glyphStats.misses;
+            if(frame >= BENCH_WARMUP_FRAMES)
+            {
+                history.add(stats);
+            }
+        }
+
+        FrameStats total = history.total();
+        unsigned long long layoutLookups = total.layoutCacheHits + total.layoutCacheMisses;
+        printf("%zu glyphs in %zu lines, %u frames after %u warmup frames, %s %s atlas%s%s\n",
+               total.glyphNum / history.frameNum(), lineNum, frameNum, BENCH_WARMUP_FRAMES,
+               fontOptions.dynamicAtlas ? "dynamic" : "static", atlasFormatName(font.atlasFormat()),
+               fontOptions.signedDistanceField ? ", distance fields" : "",
+               useLayoutCache ? ", layout cache" : "");
+        printSummary("cpu", history.cpuTimeSummary());
+        printSummary("frame", history.frameTimeSummary());
+        printf("%.1f draw calls and %.1f KB uploaded per frame, layout cache hits %.1f%%, %llu glyphs rasterized\n",
+               (double)total.drawCallNum / history.frameNum(), total.uploadedByteNum / 1024.0 / history.frameNum(),
+               layoutLookups ? 100.0 * total.layoutCacheHits / layoutLookups : 0.0, total.glyphCacheMisses);
+
+        gl->glDeleteTextures(1, &texture);
+        framebuffer.release();
+    }
+    context.doneCurrent();
+    return 0;
+}
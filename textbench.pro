@@ -0,0 +1,52 @@
+#-------------------------------------------------
+#
+# Headless text rendering benchmark, draws into an offscreen
+# framebuffer and reports p50/p99 frame times
+#
+#-------------------------------------------------
+
+QT       += core gui
+
+CONFIG += c++11 thread console
+CONFIG -= app_bundle
+
+TARGET = textbench
+TEMPLATE = app
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+INCLUDEPATH += \
+    /usr/include/freetype2
+
+LIBS += \
+    -lfreetype
+
+SOURCES += \
+    textbench.cpp \
+    texturefont.cpp \
+    eaccodec.cpp \
+    atlaspacker.cpp \
+    characterset.cpp \
+    textbatch.cpp \
+    textlayout.cpp \
+    textlayoutcache.cpp \
+    atlasuploader.cpp \
+    framestats.cpp \
+    textcompositor.cpp \
+    glcheck.cpp
+
+HEADERS += \
+    texturefont.h \
+    eaccodec.h \
+    atlaspacker.h \
+    characterset.h \
+    textbatch.h \
+    textlayout.h \
+    textlayoutcache.h \
+    atlasuploader.h \
+    framestats.h \
+    textcompositor.h \
+    glcheck.h
+
+RESOURCES += \
+    shaderfiles.qrc
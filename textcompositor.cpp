@@ -0,0 +1,539 @@
+#include "textcompositor.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+//TEXTCOMPOSITOR_NO_SIMD forces the scalar kernels, e.g. to compare them
+#if !defined(TEXTCOMPOSITOR_NO_SIMD) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define TEXTCOMPOSITOR_X86
+#include <immintrin.h>
+#elif !defined(TEXTCOMPOSITOR_NO_SIMD) && defined(__ARM_NEON)
+#define TEXTCOMPOSITOR_NEON
+#include <arm_neon.h>
+#endif
+
+#define BAND_HEIGHT 32  //rows of the target a thread blends at a time
+
+namespace
+{
+
+//x / 255 rounded, exact for x <= 255 * 255; every kernel rounds the same way, so they agree bit for bit
+inline unsigned int div255(unsigned int x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+//a = coverage * color alpha, then every channel d = (d * (255 - a) + source * a) / 255, the source of alpha being 255
+void blendA8Scalar(unsigned char* destination, const unsigned char* coverage, size_t num, TextColor color)
+{
+    for(size_t i = 0; i < num; i++)
+    {
+        unsigned int a = div255(coverage[i] * color.a);
+        destination[i] = div255(destination[i] * (255 - a) + 255 * a);
+    }
+}
+
+void blendRGBA8Scalar(unsigned char* destination, const unsigned char* coverage, size_t num, TextColor color)
+{
+    for(size_t i = 0; i < num; i++)
+    {
+        unsigned int a = div255(coverage[i] * color.a);
+        if(a == 0)
+        {
+            continue;
+        }
+        unsigned char* pixel = destination + i * 4;
+        pixel[0] = div255(pixel[0] * (255 - a) + color.r * a);
+        pixel[1] = div255(pixel[1] * (255 - a) + color.g * a);
+        pixel[2] = div255(pixel[2] * (255 - a) + color.b * a);
+        pixel[3] = div255(pixel[3] * (255 - a) + 255 * a);
+    }
+}
+
+//an LCD atlas, coverage holds 3 bytes per pixel: every color channel mixes by the coverage of its own
+//subpixel, the alpha channel by their mean. Scalar only, LCD text is rarely blended on the CPU
+void blendLcdRGBA8Scalar(unsigned char* destination, const unsigned char* coverage, size_t num, TextColor color)
+{
+    for(size_t i = 0; i < num; i++)
+    {
+        const unsigned char* subpixels = coverage + i * 3;
+        unsigned int r = div255(subpixels[0] * color.a);
+        unsigned int g = div255(subpixels[1] * color.a);
+        unsigned int b = div255(subpixels[2] * color.a);
+        if((r | g | b) == 0)
+        {
+            continue;
+        }
+        unsigned int a = (r + g + b + 1) / 3;
+        unsigned char* pixel = destination + i * 4;
+        pixel[0] = div255(pixel[0] * (255 - r) + color.r * r);
+        pixel[1] = div255(pixel[1] * (255 - g) + color.g * g);
+        pixel[2] = div255(pixel[2] * (255 - b) + color.b * b);
+        pixel[3] = div255(pixel[3] * (255 - a) + 255 * a);
+    }
+}
+
+#ifdef TEXTCOMPOSITOR_X86
+inline __m128i div255SSE2(__m128i x)
+{
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+inline __m128i blend16SSE2(__m128i destination, __m128i source, __m128i a)
+{
+    __m128i inverse = _mm_sub_epi16(_mm_set1_epi16(255), a);
+    return div255SSE2(_mm_add_epi16(_mm_mullo_epi16(destination, inverse), _mm_mullo_epi16(source, a)));
+}
+
+//16 pixels, as 16 bit lanes
+inline void blendA8StepSSE2(unsigned char* destination, const unsigned char* coverage, __m128i alpha)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i source = _mm_set1_epi16(255);
+    __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(coverage));
+    __m128i d = _mm_loadu_si128(reinterpret_cast<__m128i*>(destination));
+    __m128i aLow = div255SSE2(_mm_mullo_epi16(_mm_unpacklo_epi8(c, zero), alpha));
+    __m128i aHigh = div255SSE2(_mm_mullo_epi16(_mm_unpackhi_epi8(c, zero), alpha));
+    __m128i low = blend16SSE2(_mm_unpacklo_epi8(d, zero), source, aLow);
+    __m128i high = blend16SSE2(_mm_unpackhi_epi8(d, zero), source, aHigh);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(destination), _mm_packus_epi16(low, high));
+}
+
+//4 pixels, the alpha of every pixel is spread over its 4 channels
+inline void blendRGBA8StepSSE2(unsigned char* destination, const unsigned char* coverage, __m128i alpha, __m128i source)
+{
+    __m128i zero = _mm_setzero_si128();
+    int c;
+    memcpy(&c, coverage, sizeof(c));
+    __m128i a = div255SSE2(_mm_mullo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(c), zero), alpha));
+    a = _mm_unpacklo_epi16(a, a);
+    __m128i d = _mm_loadu_si128(reinterpret_cast<__m128i*>(destination));
+    __m128i low = blend16SSE2(_mm_unpacklo_epi8(d, zero), source, _mm_unpacklo_epi32(a, a));
+    __m128i high = blend16SSE2(_mm_unpackhi_epi8(d, zero), source, _mm_unpackhi_epi32(a, a));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(destination), _mm_packus_epi16(low, high));
+}
+
+void blendA8SSE2(unsigned char* destination, const unsigned char* coverage, size_t num, TextColor color)
+{
+    __m128i alpha = _mm_set1_epi16(color.a);
+    size_t i = 0;
+    for(; i + 16 <= num; i += 16)
+    {
+        blendA8StepSSE2(destination + i, coverage + i, alpha);
+    }
+    blendA8Scalar(destination + i, coverage + i, num - i, color);
+}
+
+void blendRGBA8SSE2(unsigned char* destination, const unsigned char* coverage, size_t num, TextColor color)
+{
+    __m128i alpha = _mm_set1_epi16(color.a);
+    __m128i source = _mm_setr_epi16(color.r, color.g, color.b, 255, color.r, color.g, color.b, 255);
+    size_t i = 0;
+    for(; i + 4 <= num; i += 4)
+    {
+        blendRGBA8StepSSE2(destination + i * 4, coverage + i, alpha, source);
+    }
+    blendRGBA8Scalar(destination + i * 4, coverage + i, num - i, color);
+}
+
+#if defined(__GNUC__)
+#define TEXTCOMPOSITOR_AVX2
+__attribute__((target("avx2")))
+inline __m256i div255AVX2(__m256i x)
+{
+    x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+__attribute__((target("avx2")))
+inline __m256i blend16AVX2(__m256i destination, __m256i source, __m256i a)
+{
+    __m256i inverse = _mm256_sub_epi16(_mm256_set1_epi16(255), a);
+    return div255AVX2(_mm256_add_epi16(_mm256_mullo_epi16(destination, inverse), _mm256_mullo_epi16(source, a)));
+}
+
+//32 pixels; the unpacks stay within 128 bit lanes, for the coverage and the target alike
+__attribute__((target("avx2")))
+inline void blendA8StepAVX2(unsigned char* destination, const unsigned char* coverage, __m256i alpha)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i source = _mm256_set1_epi16(255);
+    __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(coverage));
+    __m256i d = _mm256_loadu_si256(reinterpret_cast<__m256i*>(destination));
+    __m256i aLow = div255AVX2(_mm256_mullo_epi16(_mm256_unpacklo_epi8(c, zero), alpha));
+    __m256i aHigh = div255AVX2(_mm256_mullo_epi16(_mm256_unpackhi_epi8(c, zero), alpha));
+    __m256i low = blend16AVX2(_mm256_unpacklo_epi8(d, zero), source, aLow);
+    __m256i high = blend16AVX2(_mm256_unpackhi_epi8(d, zero), source, aHigh);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination), _mm256_packus_epi16(low, high));
+}
+
+//8 pixels: pixels 0..3 in the low lane and 4..7 in the high one, so the alphas are spread per half
+//first and the halves combined
+__attribute__((target("avx2")))
+inline void blendRGBA8StepAVX2(unsigned char* destination, const unsigned char* coverage, __m128i alpha, __m256i source)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m128i c = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(coverage));
+    __m128i a = div255SSE2(_mm_mullo_epi16(_mm_unpacklo_epi8(c, _mm_setzero_si128()), alpha));
+    __m128i a0123 = _mm_unpacklo_epi16(a, a);
+    __m128i a4567 = _mm_unpackhi_epi16(a, a);
+    __m256i aLow = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi32(a0123, a0123)), _mm_unpacklo_epi32(a4567, a4567), 1);
+    __m256i aHigh = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpackhi_epi32(a0123, a0123)), _mm_unpackhi_epi32(a4567, a4567), 1);
+    __m256i d = _mm256_loadu_si256(reinterpret_cast<__m256i*>(destination));
+    __m256i low = blend16AVX2(_mm256_unpacklo_epi8(d, zero), source, aLow);
+    __m256i high = blend16AVX2(_mm256_unpackhi_epi8(d, zero), source, aHigh);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination), _mm256_packus_epi16(low, high));
+}
+
+//glyph rows are mostly narrower than 32 pixels, so a 16 pixel step comes before the scalar tail. The
+//upper halves are cleared before the tail, legacy SSE code after dirty ones stalls on every row
+__attribute__((target("avx2")))
+void blendA8AVX2(unsigned char* destination, const unsigned char* coverage, size_t num, TextColor color)
+{
+    __m256i alpha = _mm256_set1_epi16(color.a);
+    size_t i = 0;
+    for(; i + 32 <= num; i += 32)
+    {
+        blendA8StepAVX2(destination + i, coverage + i, alpha);
+    }
+    if(i + 16 <= num)
+    {
+        blendA8StepSSE2(destination + i, coverage + i, _mm256_castsi256_si128(alpha));
+        i += 16;
+    }
+    _mm256_zeroupper();
+    blendA8Scalar(destination + i, coverage + i, num - i, color);
+}
+
+__attribute__((target("avx2")))
+void blendRGBA8AVX2(unsigned char* destination, const unsigned char* coverage, size_t num, TextColor color)
+{
+    __m128i alpha = _mm_set1_epi16(color.a);
+    __m256i source = _mm256_setr_epi16(color.r, color.g, color.b, 255, color.r, color.g, color.b, 255,
+                                       color.r, color.g, color.b, 255, color.r, color.g, color.b, 255);
+    size_t i = 0;
+    for(; i + 8 <= num; i += 8)
+    {
+        blendRGBA8StepAVX2(destination + i * 4, coverage + i, alpha, source);
+    }
+    if(i + 4 <= num)
+    {
+        blendRGBA8StepSSE2(destination + i * 4, coverage + i, alpha, _mm256_castsi256_si128(source));
+        i += 4;
+    }
+    _mm256_zeroupper();
+    blendRGBA8Scalar(destination + i * 4, coverage + i, num - i, color);
+}
+#endif
+#endif
+
+#ifdef TEXTCOMPOSITOR_NEON
+//(x + 128 + ((x + 128) >> 8)) >> 8, narrowed
+inline uint8x8_t div255NEON(uint16x8_t x)
+{
+    return vraddhn_u16(x, vrshrq_n_u16(x, 8));
+}
+
+inline void blendA8StepNEON(unsigned char* destination, const unsigned char* coverage, uint8x8_t alpha)
+{
+    uint8x8_t full = vdup_n_u8(255);
+    uint8x8_t a = div255NEON(vmull_u8(vld1_u8(coverage), alpha));
+    uint8x8_t inverse = vsub_u8(full, a);
+    vst1_u8(destination, div255NEON(vmlal_u8(vmull_u8(vld1_u8(destination), inverse), full, a)));
+}
+
+//8 pixels, deinterleaved into channels by the structure loads
+inline void blendRGBA8StepNEON(unsigned char* destination, const unsigned char* coverage, uint8x8_t alpha, uint8x8x4_t source)
+{
+    uint8x8_t full = vdup_n_u8(255);
+    uint8x8_t a = div255NEON(vmull_u8(vld1_u8(coverage), alpha));
+    uint8x8_t inverse = vsub_u8(full, a);
+    uint8x8x4_t d = vld4_u8(destination);
+    for(int channel = 0; channel < 4; channel++)
+    {
+        d.val[channel] = div255NEON(vmlal_u8(vmull_u8(d.val[channel], inverse), source.val[channel], a));
+    }
+    vst4_u8(destination, d);
+}
+
+void blendA8NEON(unsigned char* destination, const unsigned char* coverage, size_t num, TextColor color)
+{
+    uint8x8_t alpha = vdup_n_u8(color.a);
+    size_t i = 0;
+    for(; i + 8 <= num; i += 8)
+    {
+        blendA8StepNEON(destination + i, coverage + i, alpha);
+    }
+    blendA8Scalar(destination + i, coverage + i, num - i, color);
+}
+
+void blendRGBA8NEON(unsigned char* destination, const unsigned char* coverage, size_t num, TextColor color)
+{
+    uint8x8_t alpha = vdup_n_u8(color.a);
+    uint8x8x4_t source = {{vdup_n_u8(color.r), vdup_n_u8(color.g), vdup_n_u8(color.b), vdup_n_u8(255)}};
+    size_t i = 0;
+    for(; i + 8 <= num; i += 8)
+    {
+        blendRGBA8StepNEON(destination + i * 4, coverage + i, alpha, source);
+    }
+    blendRGBA8Scalar(destination + i * 4, coverage + i, num - i, color);
+}
+#endif
+
+struct BlendKernels
+{
+    const char* name;
+    void (*a8)(unsigned char*, const unsigned char*, size_t, TextColor);
+    void (*rgba8)(unsigned char*, const unsigned char*, size_t, TextColor);
+};
+
+BlendKernels selectBlendKernels()
+{
+#if defined(TEXTCOMPOSITOR_AVX2)
+    if(__builtin_cpu_supports("avx2"))
+    {
+        return {"AVX2", blendA8AVX2, blendRGBA8AVX2};
+    }
+#endif
+#if defined(TEXTCOMPOSITOR_X86)
+    return {"SSE2", blendA8SSE2, blendRGBA8SSE2};
+#elif defined(TEXTCOMPOSITOR_NEON)
+    return {"NEON", blendA8NEON, blendRGBA8NEON};
+#else
+    return {"scalar", blendA8Scalar, blendRGBA8Scalar};
+#endif
+}
+
+const BlendKernels& blendKernels()
+{
+    static const BlendKernels kernels = selectBlendKernels();
+    return kernels;
+}
+
+}
+
+TextCompositor::TextCompositor(const TextureFont* font, unsigned int threadNum)
+    :m_font(font)
+    ,m_threadNum(0)
+    ,m_clipped(false)
+    ,m_clipX(0)
+    ,m_clipY(0)
+    ,m_clipWidth(0)
+    ,m_clipHeight(0)
+{
+    setThreadNum(threadNum);
+    //a distance of (value - 128) * spread / 128 pixels from the outline, covering the pixel from half a pixel inside
+    unsigned int spread = font->distanceFieldSpread();
+    for(unsigned int value = 0; value < 256; value++)
+    {
+        if(spread == 0)
+        {
+            m_coverage[value] = value;
+        }
+        else
+        {
+            float distance = ((float)value - 128.0f) * spread / 128.0f;
+            m_coverage[value] = (unsigned char)std::lround(std::min(1.0f, std::max(0.0f, distance + 0.5f)) * 255.0f);
+        }
+    }
+}
+
+void TextCompositor::clear()
+{
+    m_glyphs.clear();
+}
+
+void TextCompositor::addText(const std::u32string& text, float x, float y, TextColor color)
+{
+    int baseline = (int)std::floor(y + 0.5f);
+    unsigned int previousSlot = 0;
+    for(size_t i = 0; i < text.size(); i++)
+    {
+        //one lookup per character, kerned by slot like layoutText()
+        unsigned int slot = m_font->characterSlot(text[i]);
+        if(i > 0)
+        {
+            x += m_font->slotKerning(previousSlot, slot) / 64.0f;
+        }
+        unsigned int phase;
+        int pen = (int)m_font->subpixelPen(x, phase);
+        CharacterInfo info = m_font->slotCharacterInfo(slot, phase);
+        if(info.width > 0 && info.height > 0)
+        {
+            //bitmap_left and bitmap_top hold FreeType's signed offsets
+            m_glyphs.push_back(Glyph{pen + (int)info.bitmap_left, baseline - (int)info.bitmap_top,
+                                     info.width, info.height, info.x, info.y, info.page, color});
+        }
+        x += info.advance / 64.0f;
+        previousSlot = slot;
+    }
+}
+
+void TextCompositor::setClipRect(int x, int y, unsigned int width, unsigned int height)
+{
+    m_clipped = true;
+    m_clipX = x;
+    m_clipY = y;
+    m_clipWidth = width;
+    m_clipHeight = height;
+}
+
+void TextCompositor::resetClipRect()
+{
+    m_clipped = false;
+}
+
+void TextCompositor::setThreadNum(unsigned int threadNum)
+{
+    m_threadNum = threadNum == 0 ? std::max(1u, std::thread::hardware_concurrency()) : threadNum;
+}
+
+void TextCompositor::draw(const PixelBuffer& target)
+{
+    int left = 0;
+    int top = 0;
+    int right = target.width;
+    int bottom = target.height;
+    if(m_clipped)
+    {
+        left = std::max(left, m_clipX);
+        top = std::max(top, m_clipY);
+        right = std::min((long long)right, (long long)m_clipX + m_clipWidth);
+        bottom = std::min((long long)bottom, (long long)m_clipY + m_clipHeight);
+    }
+    if(m_glyphs.empty() || left >= right || top >= bottom)
+    {
+        return;
+    }
+
+    //every glyph is listed in the bands it overlaps, a glyph is rarely taller than a band
+    size_t bandNum = (bottom - top + BAND_HEIGHT - 1) / BAND_HEIGHT;
+    if(m_bands.size() < bandNum)
+    {
+        m_bands.resize(bandNum);
+    }
+    for(size_t i = 0; i < bandNum; i++)
+    {
+        m_bands[i].clear();
+    }
+    for(size_t i = 0; i < m_glyphs.size(); i++)
+    {
+        const Glyph& glyph = m_glyphs[i];
+        int glyphTop = std::max(glyph.y, top);
+        int glyphBottom = std::min(glyph.y + (int)glyph.height, bottom);
+        if(glyphTop >= glyphBottom || glyph.x >= right || glyph.x + (int)glyph.width <= left)
+        {
+            continue;
+        }
+        for(int band = (glyphTop - top) / BAND_HEIGHT; band <= (glyphBottom - 1 - top) / BAND_HEIGHT; band++)
+        {
+            m_bands[band].push_back(i);
+        }
+    }
+
+    //decodes a compressed texture once, before the threads read it
+    const unsigned char* atlas = m_font->texture();
+    bool convert = m_font->distanceFieldSpread() != 0 || m_font->atlasFormat() != AtlasFormat::Coverage8;
+    std::atomic<size_t> nextBand(0);
+    auto work = [&]() {
+        std::vector<unsigned char> rowBuffer(convert ? m_font->textureWidth() : 0);
+        for(size_t band = nextBand++; band < bandNum; band = nextBand++)
+        {
+            int bandTop = top + band * BAND_HEIGHT;
+            drawBand(target, atlas, m_bands[band], left, bandTop, right, std::min(bandTop + BAND_HEIGHT, bottom),
+                     convert ? rowBuffer.data() : nullptr);
+        }
+    };
+    std::vector<std::thread> workers;
+    for(unsigned int t = 1; t < m_threadNum && t < bandNum; t++)
+    {
+        workers.emplace_back(work);
+    }
+    work();
+    for(auto& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+size_t TextCompositor::glyphNum() const
+{
+    return m_glyphs.size();
+}
+
+void TextCompositor::drawBand(const PixelBuffer& target, const unsigned char* atlas, const std::vector<unsigned int>& glyphs,
+                              int left, int top, int right, int bottom, unsigned char* rowBuffer) const
+{
+    const BlendKernels& kernels = blendKernels();
+    auto blend = target.format == PixelFormat::A8 ? kernels.a8 : kernels.rgba8;
+    size_t pixelSize = target.format == PixelFormat::A8 ? 1 : 4;
+    AtlasFormat format = m_font->atlasFormat();
+    bool componentAlpha = format == AtlasFormat::LCD && target.format == PixelFormat::RGBA8;
+    size_t rowBytes = m_font->textureRowBytes();
+    size_t pageSize = rowBytes * m_font->textureHeight();
+    for(auto iter = glyphs.begin(); iter != glyphs.end(); iter++)
+    {
+        const Glyph& glyph = m_glyphs[*iter];
+        int x0 = std::max(glyph.x, left);
+        int x1 = std::min(glyph.x + (int)glyph.width, right);
+        int y0 = std::max(glyph.y, top);
+        int y1 = std::min(glyph.y + (int)glyph.height, bottom);
+        if(x0 >= x1 || y0 >= y1)
+        {
+            continue;
+        }
+        size_t width = x1 - x0;
+        unsigned int column = glyph.atlasX + (x0 - glyph.x);  //odd for a clipped Coverage4 glyph
+        const unsigned char* source = atlas + glyph.page * pageSize + (size_t)(glyph.atlasY + y0 - glyph.y) * rowBytes;
+        unsigned char* destination = target.pixels + (size_t)y0 * target.stride + (size_t)x0 * pixelSize;
+        for(int y = y0; y < y1; y++)
+        {
+            if(componentAlpha)
+            {
+                blendLcdRGBA8Scalar(destination, source + (size_t)column * 3, width, glyph.color);
+            }
+            else
+            {
+                const unsigned char* coverage = source + column;
+                if(format == AtlasFormat::Coverage4)
+                {
+                    for(size_t i = 0; i < width; i++)
+                    {
+                        size_t pixel = column + i;
+                        rowBuffer[i] = (source[pixel / 2] >> (pixel % 2 * 4) & 15) * 17;
+                    }
+                    coverage = rowBuffer;
+                }
+                else if(format == AtlasFormat::LCD)
+                {
+                    const unsigned char* subpixels = source + (size_t)column * 3;
+                    for(size_t i = 0; i < width; i++)
+                    {
+                        rowBuffer[i] = (subpixels[i * 3] + subpixels[i * 3 + 1] + subpixels[i * 3 + 2] + 1) / 3;
+                    }
+                    coverage = rowBuffer;
+                }
+                else if(rowBuffer)
+                {
+                    for(size_t i = 0; i < width; i++)
+                    {
+                        rowBuffer[i] = m_coverage[coverage[i]];
+                    }
+                    coverage = rowBuffer;
+                }
+                blend(destination, coverage, width, glyph.color);
+            }
+            source += rowBytes;
+            destination += target.stride;
+        }
+    }
+}
+
+const char* blendKernelName()
+{
+    return blendKernels().name;
+}
@@ -0,0 +1,90 @@
+#ifndef TEXTCOMPOSITOR_H
+#define TEXTCOMPOSITOR_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "texturefont.h"
+
+enum class PixelFormat
+{
+    A8,     //coverage only
+    RGBA8   //4 bytes per pixel, alpha last; any order of the color bytes works if TextColor uses the same
+};
+
+//a CPU side framebuffer, row 0 is the top one
+struct PixelBuffer
+{
+    unsigned char* pixels;
+    unsigned int width;
+    unsigned int height;
+    size_t stride;  //in byte
+    PixelFormat format;
+};
+
+struct TextColor
+{
+    unsigned char r;
+    unsigned char g;
+    unsigned char b;
+    unsigned char a;
+};
+
+//blends glyphs from the atlas of one TextureFont into a PixelBuffer without any GL context,
+//1:1 at whole pixel positions, or the nearest subpixel variant if the font has them. Source over
+//with a straight alpha color: the color channels are mixed towards the color by coverage * alpha
+//and the alpha channel accumulates it.
+//Distance field atlases are thresholded into coverage at the baked size. LCD atlases are blended per
+//subpixel into RGBA8 targets and by the mean of the subpixels into A8 ones.
+//draw() splits the target into bands of rows and blends them on threadNum threads
+class TextCompositor final
+{
+public:
+    explicit TextCompositor(const TextureFont* font, unsigned int threadNum = 1);
+
+    void clear();
+    //lays text out left to right from the pen position (x, y) on the baseline, in pixels of the
+    //target; y grows downwards. With a dynamic atlas, draw() before the font evicts the glyphs
+    void addText(const std::u32string& text, float x, float y, TextColor color);
+    void setClipRect(int x, int y, unsigned int width, unsigned int height);  //in pixels of the target
+    void resetClipRect();  //the whole target
+    void setThreadNum(unsigned int threadNum);  //0 means std::thread::hardware_concurrency()
+    void draw(const PixelBuffer& target);
+    size_t glyphNum() const;
+
+private:
+    TextCompositor& operator=(const TextCompositor&) = delete;
+    TextCompositor(const TextCompositor&) = delete;
+
+    struct Glyph
+    {
+        int x;  //of the top left pixel in the target
+        int y;
+        unsigned int width;
+        unsigned int height;
+        unsigned int atlasX;
+        unsigned int atlasY;
+        unsigned int page;
+        TextColor color;
+    };
+
+    //rows top..bottom - 1 and columns left..right - 1 of the target
+    void drawBand(const PixelBuffer& target, const unsigned char* atlas, const std::vector<unsigned int>& glyphs,
+                  int left, int top, int right, int bottom, unsigned char* rowBuffer) const;  //rowBuffer unless the atlas is plain coverage8
+
+private:
+    const TextureFont* m_font;
+    unsigned int m_threadNum;
+    std::vector<Glyph> m_glyphs;
+    bool m_clipped;
+    int m_clipX;
+    int m_clipY;
+    unsigned int m_clipWidth;
+    unsigned int m_clipHeight;
+    unsigned char m_coverage[256];  //of every atlas value, the identity unless the atlas holds distance fields
+    std::vector<std::vector<unsigned int> > m_bands;  //glyphs overlapping each band, kept to reuse the memory
+};
+
+const char* blendKernelName();  //the instruction set the blend kernels were dispatched to
+
+#endif // TEXTCOMPOSITOR_H
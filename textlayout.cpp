@@ -0,0 +1,259 @@
+#include "textlayout.h"
+
+//TEXTLAYOUT_NO_SIMD forces the scalar kernels, e.g. to compare them
+#if !defined(TEXTLAYOUT_NO_SIMD) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define TEXTLAYOUT_X86
+#include <immintrin.h>
+#elif !defined(TEXTLAYOUT_NO_SIMD) && defined(__ARM_NEON)
+#define TEXTLAYOUT_NEON
+#include <arm_neon.h>
+#endif
+
+void GlyphLayoutTable::resize(size_t slotNum)
+{
+    left.resize(slotNum);
+    top.resize(slotNum);
+    width.resize(slotNum);
+    height.resize(slotNum);
+    advance.resize(slotNum);
+    u0.resize(slotNum);
+    v0.resize(slotNum);
+    u1.resize(slotNum);
+    v1.resize(slotNum);
+    page.resize(slotNum);
+}
+
+namespace
+{
+
+float layoutPenPositionsScalar(const float* advance, size_t num, float x, float scale, float* penX)
+{
+    for(size_t i = 0; i < num; i++)
+    {
+        penX[i] = x;
+        x += advance[i] * scale;
+    }
+    return x;
+}
+
+void layoutQuad(const GlyphLayoutTable& table, unsigned int slot, float penX, float y, float z, float scale, TextVertex* vertices)
+{
+    float left = penX + table.left[slot] * scale;
+    float top = y + table.top[slot] * scale;
+    float right = left + table.width[slot] * scale;
+    float bottom = top - table.height[slot] * scale;
+    float page = table.page[slot];
+    vertices[0] = {left, top, z, table.u0[slot], table.v0[slot], page};
+    vertices[1] = {left, bottom, z, table.u0[slot], table.v1[slot], page};
+    vertices[2] = {right, top, z, table.u1[slot], table.v0[slot], page};
+    vertices[3] = {right, bottom, z, table.u1[slot], table.v1[slot], page};
+}
+
+void layoutQuadsScalar(const GlyphLayoutTable& table, const unsigned int* slots, const float* penX, size_t num,
+                       float y, float z, float scale, TextVertex* vertices)
+{
+    for(size_t i = 0; i < num; i++)
+    {
+        layoutQuad(table, slots[i], penX[i], y, z, scale, vertices + i * 4);
+    }
+}
+
+#ifdef TEXTLAYOUT_X86
+//the prefix sum runs over 4 lanes in two shifted adds, the last lane carries into the next 4
+float layoutPenPositionsSSE2(const float* advance, size_t num, float x, float scale, float* penX)
+{
+    __m128 s = _mm_set1_ps(scale);
+    __m128 carry = _mm_set1_ps(x);
+    size_t i = 0;
+    for(; i + 4 <= num; i += 4)
+    {
+        __m128 a = _mm_mul_ps(_mm_loadu_ps(advance + i), s);
+        a = _mm_add_ps(a, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(a), 4)));
+        a = _mm_add_ps(a, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(a), 8)));
+        __m128 inclusive = _mm_add_ps(a, carry);
+        __m128 exclusive = _mm_move_ss(_mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(inclusive), 4)), carry);
+        _mm_storeu_ps(penX + i, exclusive);
+        carry = _mm_shuffle_ps(inclusive, inclusive, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+    return layoutPenPositionsScalar(advance + i, num - i, _mm_cvtss_f32(carry), scale, penX + i);
+}
+
+#if defined(__GNUC__)
+#define TEXTLAYOUT_AVX2
+//r0..r7 hold one float of 8 glyphs each; stores them as floats offset..offset + 7 of the glyphs' 24
+__attribute__((target("avx2")))
+inline void storeTransposed8(__m256 r0, __m256 r1, __m256 r2, __m256 r3, __m256 r4, __m256 r5, __m256 r6, __m256 r7,
+                             float* out, size_t offset)
+{
+    __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+    __m256 t1 = _mm256_unpackhi_ps(r0, r1);
+    __m256 t2 = _mm256_unpacklo_ps(r2, r3);
+    __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+    __m256 t4 = _mm256_unpacklo_ps(r4, r5);
+    __m256 t5 = _mm256_unpackhi_ps(r4, r5);
+    __m256 t6 = _mm256_unpacklo_ps(r6, r7);
+    __m256 t7 = _mm256_unpackhi_ps(r6, r7);
+    __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+    _mm256_storeu_ps(out + offset, _mm256_permute2f128_ps(s0, s4, 0x20));
+    _mm256_storeu_ps(out + 24 + offset, _mm256_permute2f128_ps(s1, s5, 0x20));
+    _mm256_storeu_ps(out + 48 + offset, _mm256_permute2f128_ps(s2, s6, 0x20));
+    _mm256_storeu_ps(out + 72 + offset, _mm256_permute2f128_ps(s3, s7, 0x20));
+    _mm256_storeu_ps(out + 96 + offset, _mm256_permute2f128_ps(s0, s4, 0x31));
+    _mm256_storeu_ps(out + 120 + offset, _mm256_permute2f128_ps(s1, s5, 0x31));
+    _mm256_storeu_ps(out + 144 + offset, _mm256_permute2f128_ps(s2, s6, 0x31));
+    _mm256_storeu_ps(out + 168 + offset, _mm256_permute2f128_ps(s3, s7, 0x31));
+}
+
+//8 glyphs per step with hardware gathers, their 24 floats are written as three 8x8 transposes
+__attribute__((target("avx2")))
+void layoutQuadsAVX2(const GlyphLayoutTable& table, const unsigned int* slots, const float* penX, size_t num,
+                     float y, float z, float scale, TextVertex* vertices)
+{
+    __m256 s = _mm256_set1_ps(scale);
+    __m256 baseline = _mm256_set1_ps(y);
+    __m256 depth = _mm256_set1_ps(z);
+    size_t i = 0;
+    for(; i + 8 <= num; i += 8)
+    {
+        __m256i slot = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(slots + i));
+        __m256 left = _mm256_add_ps(_mm256_loadu_ps(penX + i), _mm256_mul_ps(_mm256_i32gather_ps(table.left.data(), slot, 4), s));
+        __m256 top = _mm256_add_ps(baseline, _mm256_mul_ps(_mm256_i32gather_ps(table.top.data(), slot, 4), s));
+        __m256 right = _mm256_add_ps(left, _mm256_mul_ps(_mm256_i32gather_ps(table.width.data(), slot, 4), s));
+        __m256 bottom = _mm256_sub_ps(top, _mm256_mul_ps(_mm256_i32gather_ps(table.height.data(), slot, 4), s));
+        __m256 u0 = _mm256_i32gather_ps(table.u0.data(), slot, 4);
+        __m256 v0 = _mm256_i32gather_ps(table.v0.data(), slot, 4);
+        __m256 u1 = _mm256_i32gather_ps(table.u1.data(), slot, 4);
+        __m256 v1 = _mm256_i32gather_ps(table.v1.data(), slot, 4);
+        __m256 page = _mm256_i32gather_ps(table.page.data(), slot, 4);
+        float* out = &vertices[i * 4].x;
+        storeTransposed8(left, top, depth, u0, v0, page, left, bottom, out, 0);
+        storeTransposed8(depth, u0, v1, page, right, top, depth, u1, out, 8);
+        storeTransposed8(v0, page, right, bottom, depth, u1, v1, page, out, 16);
+    }
+    layoutQuadsScalar(table, slots + i, penX + i, num - i, y, z, scale, vertices + i * 4);
+}
+#endif
+#endif
+
+#ifdef TEXTLAYOUT_NEON
+float layoutPenPositionsNEON(const float* advance, size_t num, float x, float scale, float* penX)
+{
+    float32x4_t zero = vdupq_n_f32(0.0f);
+    float32x4_t carry = vdupq_n_f32(x);
+    size_t i = 0;
+    for(; i + 4 <= num; i += 4)
+    {
+        float32x4_t a = vmulq_n_f32(vld1q_f32(advance + i), scale);
+        a = vaddq_f32(a, vextq_f32(zero, a, 3));
+        a = vaddq_f32(a, vextq_f32(zero, a, 2));
+        float32x4_t inclusive = vaddq_f32(a, carry);
+        vst1q_f32(penX + i, vextq_f32(carry, inclusive, 3));
+        carry = vdupq_n_f32(vgetq_lane_f32(inclusive, 3));
+    }
+    return layoutPenPositionsScalar(advance + i, num - i, vgetq_lane_f32(carry, 0), scale, penX + i);
+}
+
+inline float32x4_t gather4(const std::vector<float>& column, const unsigned int* slots)
+{
+    float32x4_t v = vld1q_dup_f32(&column[slots[0]]);
+    v = vld1q_lane_f32(&column[slots[1]], v, 1);
+    v = vld1q_lane_f32(&column[slots[2]], v, 2);
+    return vld1q_lane_f32(&column[slots[3]], v, 3);
+}
+
+inline void storeTransposed(float32x4_t a, float32x4_t b, float32x4_t c, float32x4_t d, float* out, size_t offset)
+{
+    float32x4x2_t ab = vtrnq_f32(a, b);
+    float32x4x2_t cd = vtrnq_f32(c, d);
+    vst1q_f32(out + offset, vcombine_f32(vget_low_f32(ab.val[0]), vget_low_f32(cd.val[0])));
+    vst1q_f32(out + 24 + offset, vcombine_f32(vget_low_f32(ab.val[1]), vget_low_f32(cd.val[1])));
+    vst1q_f32(out + 48 + offset, vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0])));
+    vst1q_f32(out + 72 + offset, vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1])));
+}
+
+void layoutQuadsNEON(const GlyphLayoutTable& table, const unsigned int* slots, const float* penX, size_t num,
+                     float y, float z, float scale, TextVertex* vertices)
+{
+    float32x4_t baseline = vdupq_n_f32(y);
+    float32x4_t depth = vdupq_n_f32(z);
+    size_t i = 0;
+    for(; i + 4 <= num; i += 4)
+    {
+        const unsigned int* slot = slots + i;
+        float32x4_t left = vmlaq_n_f32(vld1q_f32(penX + i), gather4(table.left, slot), scale);
+        float32x4_t top = vmlaq_n_f32(baseline, gather4(table.top, slot), scale);
+        float32x4_t right = vmlaq_n_f32(left, gather4(table.width, slot), scale);
+        float32x4_t bottom = vmlsq_n_f32(top, gather4(table.height, slot), scale);
+        float32x4_t u0 = gather4(table.u0, slot);
+        float32x4_t v0 = gather4(table.v0, slot);
+        float32x4_t u1 = gather4(table.u1, slot);
+        float32x4_t v1 = gather4(table.v1, slot);
+        float32x4_t page = gather4(table.page, slot);
+        float* out = &vertices[i * 4].x;
+        storeTransposed(left, top, depth, u0, out, 0);
+        storeTransposed(v0, page, left, bottom, out, 4);
+        storeTransposed(depth, u0, v1, page, out, 8);
+        storeTransposed(right, top, depth, u1, out, 12);
+        storeTransposed(v0, page, right, bottom, out, 16);
+        storeTransposed(depth, u1, v1, page, out, 20);
+    }
+    layoutQuadsScalar(table, slots + i, penX + i, num - i, y, z, scale, vertices + i * 4);
+}
+#endif
+
+struct LayoutKernels
+{
+    const char* name;
+    float (*penPositions)(const float*, size_t, float, float, float*);
+    void (*quads)(const GlyphLayoutTable&, const unsigned int*, const float*, size_t, float, float, float, TextVertex*);
+};
+
+LayoutKernels selectLayoutKernels()
+{
+#if defined(TEXTLAYOUT_AVX2)
+    if(__builtin_cpu_supports("avx2"))
+    {
+        return {"AVX2", layoutPenPositionsSSE2, layoutQuadsAVX2};
+    }
+#endif
+#if defined(TEXTLAYOUT_X86)
+    //SSE2 has no gathers, inserting the lanes one by one and transposing them back costs
+    //more shuffles than the scalar loop spends on its stores
+    return {"SSE2", layoutPenPositionsSSE2, layoutQuadsScalar};
+#elif defined(TEXTLAYOUT_NEON)
+    return {"NEON", layoutPenPositionsNEON, layoutQuadsNEON};
+#else
+    return {"scalar", layoutPenPositionsScalar, layoutQuadsScalar};
+#endif
+}
+
+const LayoutKernels& layoutKernels()
+{
+    static const LayoutKernels kernels = selectLayoutKernels();
+    return kernels;
+}
+
+}
+
+float layoutPenPositions(const float* advance, size_t num, float x, float scale, float* penX)
+{
+    return layoutKernels().penPositions(advance, num, x, scale, penX);
+}
+
+void layoutQuads(const GlyphLayoutTable& table, const unsigned int* slots, const float* penX, size_t num,
+                 float y, float z, float scale, TextVertex* vertices)
+{
+    layoutKernels().quads(table, slots, penX, num, y, z, scale, vertices);
+}
+
+const char* layoutKernelName()
+{
+    return layoutKernels().name;
+}
@@ -0,0 +1,42 @@
+#ifndef TEXTLAYOUT_H
+#define TEXTLAYOUT_H
+
+#include <cstddef>
+#include <vector>
+
+struct TextVertex
+{
+    float x;
+    float y;
+    float z;
+    float u;
+    float v;
+    float page;
+};
+
+//quad geometry and normalized texture coordinates of every glyph slot of a font, kept as
+//structure of arrays so the layout kernels load them lane by lane
+struct GlyphLayoutTable
+{
+    void resize(size_t slotNum);
+
+    std::vector<float> left;     //of the quad relative to the pen, in pixel
+    std::vector<float> top;      //of the quad above the baseline, in pixel
+    std::vector<float> width;    //in pixel
+    std::vector<float> height;   //in pixel
+    std::vector<float> advance;  //of the pen, in pixel
+    std::vector<float> u0;
+    std::vector<float> v0;
+    std::vector<float> u1;
+    std::vector<float> v1;
+    std::vector<float> page;
+};
+
+//penX[i] = x + scale * (advance[0] + ... + advance[i - 1]), returns the pen position after the last one
+float layoutPenPositions(const float* advance, size_t num, float x, float scale, float* penX);
+//writes the 4 vertices (top left, bottom left, top right, bottom right) of every slots[i] at penX[i]
+void layoutQuads(const GlyphLayoutTable& table, const unsigned int* slots, const float* penX, size_t num,
+                 float y, float z, float scale, TextVertex* vertices);
+const char* layoutKernelName();  //the instruction set the kernels were dispatched to
+
+#endif // TEXTLAYOUT_H
@@ -0,0 +1,178 @@
+#include "textlayoutcache.h"
+#include <cstring>
+#include <iterator>
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+#define RUN_OVERHEAD_SIZE 64  //list and hash map nodes, in byte
+
+TextLayoutCache::TextLayoutCache(size_t maxByteSize)
+    :m_maxByteSize(maxByteSize)
+    ,m_uncachedRun()
+    ,m_stats{0, 0, 0, 0, 0}
+{
+
+}
+
+TextRun TextLayoutCache::layout(const TextureFont* font, const std::u32string& text, float scale, float x)
+{
+    uint64_t key = hash(font, text, scale, x);
+    auto iter = m_runMap.find(key);
+    if(iter != m_runMap.end())
+    {
+        Run& run = *iter->second;
+        if(run.font == font && run.scale == scale && run.x == x && run.text == text)
+        {
+            m_runs.splice(m_runs.begin(), m_runs, iter->second);
+            if(run.atlasGeneration == font->atlasGeneration())
+            {
+                m_stats.hits++;
+                return TextRun{run.vertices.data(), run.vertices.size() / 4, run.advance};
+            }
+            //its glyphs may have moved in or arrived to the atlas, the text stays the same but glyphs
+            //without pixels aren't drawn, so the run may have grown or shrunk
+            m_stats.misses++;
+            layoutRun(run);
+            size_t byteSize = runByteSize(run);
+            if(byteSize > m_maxByteSize)
+            {
+                m_uncachedRun = run;
+                eraseRun(iter->second);
+                return TextRun{m_uncachedRun.vertices.data(), m_uncachedRun.vertices.size() / 4, m_uncachedRun.advance};
+            }
+            m_stats.byteSize = m_stats.byteSize - run.byteSize + byteSize;
+            run.byteSize = byteSize;
+            evictRuns();
+            return TextRun{run.vertices.data(), run.vertices.size() / 4, run.advance};
+        }
+        //another text with the same hash, the newer one replaces it
+        eraseRun(iter->second);
+    }
+
+    m_stats.misses++;
+    Run run;
+    run.hash = key;
+    run.font = font;
+    run.scale = scale;
+    run.x = x;
+    run.text = text;
+    layoutRun(run);
+    run.byteSize = runByteSize(run);
+    if(run.byteSize > m_maxByteSize)
+    {
+        m_uncachedRun = std::move(run);
+        return TextRun{m_uncachedRun.vertices.data(), m_uncachedRun.vertices.size() / 4, m_uncachedRun.advance};
+    }
+    m_stats.byteSize += run.byteSize;
+    m_stats.runNum++;
+    m_runs.push_front(std::move(run));
+    m_runMap[key] = m_runs.begin();
+    evictRuns();
+    const Run& inserted = m_runs.front();
+    return TextRun{inserted.vertices.data(), inserted.vertices.size() / 4, inserted.advance};
+}
+
+void TextLayoutCache::removeFont(const TextureFont* font)
+{
+    for(auto iter = m_runs.begin(); iter != m_runs.end();)
+    {
+        auto next = std::next(iter);
+        if(iter->font == font)
+        {
+            eraseRun(iter);
+        }
+        iter = next;
+    }
+    if(m_uncachedRun.font == font)
+    {
+        m_uncachedRun = Run();
+    }
+}
+
+void TextLayoutCache::clear()
+{
+    m_runs.clear();
+    m_runMap.clear();
+    m_uncachedRun = Run();
+    m_stats.runNum = 0;
+    m_stats.byteSize = 0;
+}
+
+void TextLayoutCache::setMaxByteSize(size_t maxByteSize)
+{
+    m_maxByteSize = maxByteSize;
+    evictRuns();
+}
+
+size_t TextLayoutCache::maxByteSize() const
+{
+    return m_maxByteSize;
+}
+
+TextLayoutCacheStats TextLayoutCache::stats() const
+{
+    return m_stats;
+}
+
+float TextLayoutCache::hitRate() const
+{
+    unsigned long long lookups = m_stats.hits + m_stats.misses;
+    return lookups ? 100.0f * m_stats.hits / lookups : 0.0f;
+}
+
+void TextLayoutCache::resetStats()
+{
+    m_stats.hits = 0;
+    m_stats.misses = 0;
+    m_stats.evictions = 0;
+}
+
+uint64_t TextLayoutCache::hash(const TextureFont* font, const std::u32string& text, float scale, float x)
+{
+    uint32_t scaleBits;
+    memcpy(&scaleBits, &scale, sizeof(scaleBits));
+    uint32_t xBits;
+    memcpy(&xBits, &x, sizeof(xBits));
+    uint64_t h = (FNV_OFFSET_BASIS ^ (uint64_t)(uintptr_t)font) * FNV_PRIME;
+    h = (h ^ scaleBits) * FNV_PRIME;
+    h = (h ^ xBits) * FNV_PRIME;
+    for(char32_t character : text)
+    {
+        h = (h ^ character) * FNV_PRIME;
+    }
+    return h;
+}
+
+void TextLayoutCache::layoutRun(Run& run) const
+{
+    //a dynamic atlas may load glyphs while laying out, the run owns its vertices afterwards
+    run.vertices.resize(run.text.size() * 4);
+    size_t glyphNum = run.font->layoutText(run.text.data(), run.text.size(), run.x, 0.0f, 0.0f, run.scale,
+                                           run.vertices.data(), &run.advance);
+    run.vertices.resize(glyphNum * 4);
+    //taken afterwards, loading its own glyphs may have evicted others
+    run.atlasGeneration = run.font->atlasGeneration();
+}
+
+size_t TextLayoutCache::runByteSize(const Run& run)
+{
+    return sizeof(Run) + RUN_OVERHEAD_SIZE + run.text.size() * sizeof(char32_t) + run.vertices.size() * sizeof(TextVertex);
+}
+
+void TextLayoutCache::evictRuns()
+{
+    //layout() only keeps runs within the budget, so the most recent one is never dropped by it
+    while(m_stats.byteSize > m_maxByteSize)
+    {
+        eraseRun(std::prev(m_runs.end()));
+        m_stats.evictions++;
+    }
+}
+
+void TextLayoutCache::eraseRun(std::list<Run>::iterator run)
+{
+    m_stats.byteSize -= run->byteSize;
+    m_stats.runNum--;
+    m_runMap.erase(run->hash);
+    m_runs.erase(run);
+}
@@ -0,0 +1,82 @@
+#ifndef TEXTLAYOUTCACHE_H
+#define TEXTLAYOUTCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "texturefont.h"
+
+//a laid out text, pen origin at (0, 0, 0)
+struct TextRun
+{
+    const TextVertex* vertices;  //4 per glyph
+    size_t glyphNum;
+    float advance;  //final pen position
+};
+
+struct TextLayoutCacheStats
+{
+    unsigned long long hits;
+    unsigned long long misses;     //including stale and uncacheable runs
+    unsigned long long evictions;  //least recently used runs dropped for the memory budget
+    size_t runNum;
+    size_t byteSize;
+};
+
+//keeps the vertices of recently laid out texts, keyed by (text, font, scale), so a label that
+//doesn't change costs one hash lookup instead of a layout per frame.
+//Runs are dropped least recently used first once they take more than maxByteSize.
+//A run is laid out again when the atlas generation of its font changed since, i.e. a dynamic atlas
+//evicted or a background build published glyphs; a hit doesn't make its glyphs recently used though
+class TextLayoutCache final
+{
+public:
+    explicit TextLayoutCache(size_t maxByteSize = 1024 * 1024);
+
+    //the run stays valid until the next layout(), removeFont() or clear(). The pen starts at x, which
+    //only matters for fonts with subpixel variants: callers pass the fraction of a pixel and move the run
+    //by the rest, so a handful of phases share the cache
+    TextRun layout(const TextureFont* font, const std::u32string& text, float scale, float x = 0.0f);
+    void removeFont(const TextureFont* font);  //has to be called before a font is destroyed
+    void clear();
+    void setMaxByteSize(size_t maxByteSize);
+    size_t maxByteSize() const;
+    TextLayoutCacheStats stats() const;
+    float hitRate() const;  //hits in percent of all lookups
+    void resetStats();      //hits, misses and evictions
+
+private:
+    TextLayoutCache& operator=(const TextLayoutCache&) = delete;
+    TextLayoutCache(const TextLayoutCache&) = delete;
+
+    struct Run
+    {
+        uint64_t hash;
+        const TextureFont* font;
+        float scale;
+        float x;
+        std::u32string text;
+        unsigned long long atlasGeneration;  //of the font when laid out
+        std::vector<TextVertex> vertices;
+        float advance;
+        size_t byteSize;
+    };
+
+    static uint64_t hash(const TextureFont* font, const std::u32string& text, float scale, float x);
+    void layoutRun(Run& run) const;
+    static size_t runByteSize(const Run& run);
+    void evictRuns();
+    void eraseRun(std::list<Run>::iterator run);
+
+private:
+    size_t m_maxByteSize;
+    std::list<Run> m_runs;  //most recently used first
+    std::unordered_map<uint64_t, std::list<Run>::iterator> m_runMap;
+    Run m_uncachedRun;  //larger than the whole budget
+    TextLayoutCacheStats m_stats;
+};
+
+#endif // TEXTLAYOUTCACHE_H
@@ -1,10 +1,65 @@
 #include "texturefont.h"
+#include "eaccodec.h"
+#include FT_TRUETYPE_TABLES_H
+#include FT_TRUETYPE_TAGS_H
+#include FT_LCD_FILTER_H
 #include <iostream>
 #include <iomanip>
 #include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <list>
+#include <unordered_map>
+#include <cstdint>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cmath>
 
 #define TEXTURE_WIDTH 4096
 #define BLANK_COLUMN 0
+#define UNRESOLVED_CHARACTER 0xffffffffu
+#define NO_SLOT 0xffffffffu
+#define UNICODE_CODE_POINT_NUM 0x110000u
+#define CHARACTER_BLOCK_BITS 8
+#define CHARACTER_BLOCK_SIZE (1u << CHARACTER_BLOCK_BITS)
+#define DEFAULT_DYNAMIC_PAGE_SIZE 1024
+#define LAYOUT_CHUNK_SIZE 256  //characters laid out per pass of the kernels, on the stack
+#define KERNING_FILTER_BITS 3  //log2 of the filter bits per kerning hash entry
+#define BUILD_CHUNK_SIZE 64  //glyphs a background worker rasterizes before publishing them
+#define DEFAULT_DISTANCE_FIELD_SPREAD 8
+#define MIN_DISTANCE_FIELD_SPREAD 2
+#define MAX_DISTANCE_FIELD_SPREAD 32
+#define FACE_SHIFT 24  //glyph keys hold the face of the fallback chain above the glyph index
+#define GLYPH_INDEX_MASK ((1u << FACE_SHIFT) - 1)
+#define MAX_FACE_NUM 128
+#define MAX_SUBPIXEL_POSITIONS 4
+#define MIN_COVERAGE_GAMMA 0.25f
+#define MAX_COVERAGE_GAMMA 4.0f
+#if FREETYPE_MAJOR > 2 || (FREETYPE_MAJOR == 2 && FREETYPE_MINOR >= 11)
+#define HAVE_FREETYPE_SDF
+#endif
+#define TEXTURE_FONT_FILE_MAGIC 0x54465854u  //"TXFT"
+#define TEXTURE_FONT_FILE_VERSION 3
+#define SECTION_ALIGNMENT 64
+#define TEXTURE_SECTION_ALIGNMENT 4096  //page aligned, so the mapped texture can be handed to GL as it is
+#define SECTION_TAG(a, b, c, d) ((unsigned int)(a) | ((unsigned int)(b) << 8) | ((unsigned int)(c) << 16) | ((unsigned int)(d) << 24))
+#define SECTION_TEXTURE SECTION_TAG('T', 'E', 'X', 'R')
+#define SECTION_COMPRESSED_TEXTURE SECTION_TAG('T', 'E', 'X', 'Z')
+#define COMPRESSED_BLOCK_ROWS 64
+#define SECTION_CHARACTER_INFO SECTION_TAG('C', 'H', 'I', 'F')
+#define SECTION_BLOCK_INDEX SECTION_TAG('B', 'L', 'K', 'I')
+#define SECTION_BLOCKS SECTION_TAG('B', 'L', 'K', 'S')
+#define SECTION_KERNING_PAIRS SECTION_TAG('K', 'E', 'R', 'N')
+#define SECTION_CHARACTER_SET SECTION_TAG('C', 'S', 'E', 'T')
+#define SECTION_SUBPIXEL_POSITIONS SECTION_TAG('S', 'U', 'B', 'P')
+#define SECTION_ATLAS_FORMAT SECTION_TAG('A', 'F', 'M', 'T')
+#define SECTION_EAC_TEXTURE SECTION_TAG('E', 'A', 'C', 'R')
+#define EAC_TILE_BLOCK_ROWS 16  //block rows an encoding thread takes at a time
 #define CHECK_FREETYPE_ERROR(expr) do { \
         if(FT_Error error = expr) { \
             std::cerr << "[FreeType Error 0x" << std::setbase(std::ios_base::hex) << error << std::setbase(std::ios_base::dec) << "] " << __FILE__ << ": Line " << __LINE__ << " "#expr << std::endl; \
@@ -13,11 +68,39 @@
     } \
     while(0)
 
+const char* atlasFormatName(AtlasFormat format)
+{
+    switch(format)
+    {
+    case AtlasFormat::Coverage8:
+        return "coverage8";
+    case AtlasFormat::Coverage4:
+        return "coverage4";
+    case AtlasFormat::LCD:
+        return "lcd";
+    }
+    return "unknown";
+}
+
+size_t atlasRowBytes(AtlasFormat format, unsigned int width)
+{
+    switch(format)
+    {
+    case AtlasFormat::Coverage4:
+        return ((size_t)width + 1) / 2;
+    case AtlasFormat::LCD:
+        return (size_t)width * 3;
+    default:
+        return width;
+    }
+}
+
 CharacterImage::CharacterImage()
     :m_width(0)
     ,m_height(0)
     ,m_bitmap_left(0)
     ,m_bitmap_top(0)
+    ,m_format(AtlasFormat::Coverage8)
     ,m_image(nullptr)
 {
 
@@ -28,9 +111,10 @@ CharacterImage::CharacterImage(const CharacterImage& chimage)
     ,m_height(chimage.m_height)
     ,m_bitmap_left(chimage.m_bitmap_left)
     ,m_bitmap_top(chimage.m_bitmap_top)
+    ,m_format(chimage.m_format)
 {
-    m_image = new unsigned char[m_width * m_height];
-    memcpy(m_image, chimage.m_image, m_width * m_height);
+    m_image = new unsigned char[byteSize()];
+    memcpy(m_image, chimage.m_image, byteSize());
 }
 
 CharacterImage::CharacterImage(CharacterImage&& chimage)
@@ -38,6 +122,7 @@ CharacterImage::CharacterImage(CharacterImage&& chimage)
     ,m_height(chimage.m_height)
     ,m_bitmap_left(chimage.m_bitmap_left)
     ,m_bitmap_top(chimage.m_bitmap_top)
+    ,m_format(chimage.m_format)
     ,m_image(chimage.m_image)
 {
     chimage.m_image = nullptr;
@@ -45,23 +130,34 @@ CharacterImage::CharacterImage(CharacterImage&& chimage)
 
 CharacterImage& CharacterImage::operator=(const CharacterImage& chimage)
 {
-    m_width = chimage.m_width;
-    m_height = chimage.m_height;
-    m_bitmap_left = chimage.m_bitmap_left;
-    m_bitmap_top = chimage.m_bitmap_top;
-    m_image = new unsigned char[m_width * m_height];
-    memcpy(m_image, chimage.m_image, m_width * m_height);
+    if(this != &chimage)
+    {
+        unsigned char* image = new unsigned char[chimage.byteSize()];
+        memcpy(image, chimage.m_image, chimage.byteSize());
+        delete [] m_image;
+        m_image = image;
+        m_width = chimage.m_width;
+        m_height = chimage.m_height;
+        m_bitmap_left = chimage.m_bitmap_left;
+        m_bitmap_top = chimage.m_bitmap_top;
+        m_format = chimage.m_format;
+    }
     return *this;
 }
 
 CharacterImage& CharacterImage::operator=(CharacterImage&& chimage)
 {
-    m_width = chimage.m_width;
-    m_height = chimage.m_height;
-    m_bitmap_left = chimage.m_bitmap_left;
-    m_bitmap_top = chimage.m_bitmap_top;
-    m_image = chimage.m_image;
-    chimage.m_image = nullptr;
+    if(this != &chimage)
+    {
+        delete [] m_image;
+        m_width = chimage.m_width;
+        m_height = chimage.m_height;
+        m_bitmap_left = chimage.m_bitmap_left;
+        m_bitmap_top = chimage.m_bitmap_top;
+        m_format = chimage.m_format;
+        m_image = chimage.m_image;
+        chimage.m_image = nullptr;
+    }
     return *this;
 }
 
@@ -93,268 +189,2565 @@ unsigned int CharacterImage::bitmap_top() const
     return m_bitmap_top;
 }
 
+AtlasFormat CharacterImage::format() const
+{
+    return m_format;
+}
+
 const unsigned char* CharacterImage::image() const
 {
     return m_image;
 }
 
-TextureFont::TextureFont(const char* fontFileName, unsigned int pt, unsigned int h_resolution, unsigned int v_resolution)
-    :m_texture(nullptr)
-    ,m_textureWidth(0)
-    ,m_textureHeight(0)
-    ,m_characterTotalNum(0)
-    ,m_characterInfoInvalidIndex(0)
-    ,m_pt(0)
-    ,m_characterMap(nullptr)
+size_t CharacterImage::byteSize() const
 {
-    CHECK_FREETYPE_ERROR(FT_Init_FreeType(&m_library));
-    CHECK_FREETYPE_ERROR(FT_New_Face(m_library, fontFileName, 0, &m_face));
-    CHECK_FREETYPE_ERROR(FT_Set_Char_Size(m_face, 0, pt * 64, h_resolution, v_resolution));
-    m_pt = pt;
-    m_characterTotalNum = m_face->num_glyphs;
-    m_characterMap = new unsigned int[m_characterTotalNum];
-    std::vector<std::vector<unsigned char> > tmpTexture;
+    return atlasRowBytes(m_format, m_width) * m_height;
+}
 
-    {
-        unsigned int tmpLineWidth = 0;
-        unsigned int tmpY = 0;
-        unsigned int tmpMaxLineHeight = 0;
-        bool firstInvalidGlyphIndex = true;
-        unsigned int characterIndex = 0;
+CharacterImageArena::CharacterImageArena(size_t blockSize)
+    :m_blockSize(std::max((size_t)1, blockSize))
+    ,m_block(0)
+    ,m_offset(0)
+    ,m_usedByteSize(0)
+{
+
+}
 
-        for(unsigned int i = 0; i < m_characterTotalNum; i++)
+CharacterImageView CharacterImageArena::copy(const CharacterImageView& view)
+{
+    CharacterImageView copy = view;
+    size_t rowBytes = atlasRowBytes(view.format, view.width);
+    size_t size = rowBytes * view.height;
+    unsigned char* pixels = allocate(size);
+    if(view.stride == rowBytes)
+    {
+        memcpy(pixels, view.pixels, size);
+    }
+    else
+    {
+        for(unsigned int i = 0; i < view.height; i++)
         {
-            FT_UInt glyph_index = FT_Get_Char_Index(m_face, i);
-            if(glyph_index==0)
-            {
-                if(firstInvalidGlyphIndex)
-                {
-                    m_characterInfoInvalidIndex = i;
-                    firstInvalidGlyphIndex = false;
-                }
-                else
-                {
-                    m_characterMap[i] = m_characterInfoInvalidIndex;
-                    continue;
-                }
-            }
+            memcpy(pixels + (size_t)i * rowBytes, view.pixels + (size_t)i * view.stride, rowBytes);
+        }
+    }
+    copy.pixels = pixels;
+    copy.stride = rowBytes;
+    return copy;
+}
 
-            CHECK_FREETYPE_ERROR(FT_Load_Glyph(m_face, glyph_index, FT_LOAD_DEFAULT));
-            CHECK_FREETYPE_ERROR(FT_Render_Glyph(m_face->glyph, FT_RENDER_MODE_NORMAL));
-            if(m_face->glyph->bitmap.width > TEXTURE_WIDTH) { \
-                std::cerr << "[Error] " << __FILE__ << ": Line" << __LINE__ << " m_face->glyph->bitmap.width is greater than TEXTURE_WIDTH" << std::endl;
-                exit(1);
-            }
-            CharacterInfo tmpInfo;
-            tmpInfo.bitmap_left = m_face->glyph->bitmap_left;
-            tmpInfo.bitmap_top = m_face->glyph->bitmap_top;
-            tmpInfo.width = m_face->glyph->bitmap.width;
-            tmpInfo.height = m_face->glyph->bitmap.rows;
+void CharacterImageArena::clear()
+{
+    m_block = 0;
+    m_offset = 0;
+    m_usedByteSize = 0;
+}
 
-            if(tmpLineWidth + m_face->glyph->bitmap.width + BLANK_COLUMN > TEXTURE_WIDTH)
-            {
-                for(unsigned int j = 0; j < tmpMaxLineHeight; j++)
-                {
-                    for(unsigned int k = 0; k < TEXTURE_WIDTH-tmpLineWidth; k++)
-                    {
-                        tmpTexture[tmpY+j].push_back(0);
-                    }
-                }
-                tmpLineWidth = 0;
-                tmpY += tmpMaxLineHeight;
-                tmpMaxLineHeight = 0;
-            }
+size_t CharacterImageArena::byteSize() const
+{
+    size_t size = 0;
+    for(auto iter = m_blockSizes.begin(); iter != m_blockSizes.end(); iter++)
+    {
+        size += *iter;
+    }
+    return size;
+}
 
-            tmpInfo.x = tmpLineWidth + BLANK_COLUMN;
-            tmpInfo.y = tmpY;
-            m_characterInfo.push_back(tmpInfo);
+size_t CharacterImageArena::usedByteSize() const
+{
+    return m_usedByteSize;
+}
 
-            if(tmpMaxLineHeight < m_face->glyph->bitmap.rows)
-            {
-                for(unsigned int j = 0; j < m_face->glyph->bitmap.rows - tmpMaxLineHeight; j++)
-                {
-                    tmpTexture.push_back(std::vector<unsigned char>());
-                    for(unsigned int k = 0; k < tmpLineWidth; k++)
-                    {
-                        tmpTexture[tmpY+tmpMaxLineHeight+j].push_back(0);
-                    }
-                }
-                tmpMaxLineHeight = m_face->glyph->bitmap.rows;
-            }
+unsigned char* CharacterImageArena::allocate(size_t size)
+{
+    //blocks that are too small for this image are left partly unused until the next clear()
+    while(m_block < m_blocks.size() && m_offset + size > m_blockSizes[m_block])
+    {
+        m_block++;
+        m_offset = 0;
+    }
+    if(m_block == m_blocks.size())
+    {
+        size_t blockSize = std::max(m_blockSize, size);
+        m_blocks.emplace_back(new unsigned char[blockSize]);
+        m_blockSizes.push_back(blockSize);
+    }
+    unsigned char* pixels = m_blocks[m_block].get() + m_offset;
+    m_offset += size;
+    m_usedByteSize += size;
+    return pixels;
+}
 
-            for(unsigned int j = 0; j < m_face->glyph->bitmap.rows; j++)
-            {
-                for(unsigned int k = 0; k < BLANK_COLUMN; k++)
-                {
-                    tmpTexture[tmpY+j].push_back(0);
-                }
-                for(unsigned int k = 0; k < m_face->glyph->bitmap.width; k++)
-                {
-                    tmpTexture[tmpY+j].push_back(m_face->glyph->bitmap.buffer[j*m_face->glyph->bitmap.width+k]);
-                }
-            }
-            for(unsigned int j = m_face->glyph->bitmap.rows; j < tmpMaxLineHeight; j++)
-            {
-                for(unsigned int k = 0; k < m_face->glyph->bitmap.width+BLANK_COLUMN; k++)
-                {
-                    tmpTexture[tmpY+j].push_back(0);
-                }
-            }
+struct GlyphBitmap
+{
+    CharacterInfo info;
+    std::vector<unsigned char> buffer;  //rows of info.width bytes, of 3 * info.width for LCD
+};
+
+namespace
+{
+
+//.tf file layout, native byte order: FileHeader, sectionNum FileSections, then the sections.
+//Every section is aligned and laid out exactly like the in-memory tables, so a loaded font
+//uses the mapped file in place; sections with an unknown tag are skipped
+struct FileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t headerChecksum;   //of the header and the section table, computed with this field 0
+    uint64_t payloadChecksum;  //of the sections, in table order
+    uint64_t fileSize;
+    uint32_t sectionNum;
+    uint32_t characterInfoSize;  //sizeof(CharacterInfo) of the writer
+    uint32_t textureWidth;
+    uint32_t textureHeight;
+    uint32_t pageNum;
+    uint32_t characterTotalNum;
+    uint32_t characterInfoInvalidIndex;
+    uint32_t pt;
+    uint32_t distanceFieldSpread;  //0 for coverage
+    int32_t ascender;   //in 1/64 pixel
+    int32_t descender;  //in 1/64 pixel
+    int32_t lineGap;    //in 1/64 pixel
+};
+
+struct FileSection
+{
+    uint32_t tag;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct FileSectionData
+{
+    unsigned int tag;
+    const void* data;
+    size_t size;
+    size_t alignment;
+};
+
+//FNV-1a over 8 byte words, good enough to catch truncated or damaged files
+uint64_t checksum(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    size_t i = 0;
+    for(; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * 0x100000001b3ull;
+        hash ^= hash >> 29;
+    }
+    for(; i < size; i++)
+    {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
 
-            m_characterMap[i] = characterIndex;
+size_t alignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+void writeTextureFontFile(const char* fileName, FileHeader header, const std::vector<FileSectionData>& sections)
+{
+    std::vector<FileSection> table(sections.size());
+    size_t offset = sizeof(FileHeader) + sizeof(FileSection) * sections.size();
+    header.magic = TEXTURE_FONT_FILE_MAGIC;
+    header.version = TEXTURE_FONT_FILE_VERSION;
+    header.sectionNum = sections.size();
+    header.characterInfoSize = sizeof(CharacterInfo);
+    header.payloadChecksum = checksum(nullptr, 0);
+    for(size_t i = 0; i < sections.size(); i++)
+    {
+        offset = alignUp(offset, sections[i].alignment);
+        table[i].tag = sections[i].tag;
+        table[i].reserved = 0;
+        table[i].offset = offset;
+        table[i].size = sections[i].size;
+        header.payloadChecksum = checksum(sections[i].data, sections[i].size, header.payloadChecksum);
+        offset += sections[i].size;
+    }
+    header.fileSize = offset;
+    header.headerChecksum = 0;
+    header.headerChecksum = checksum(table.data(), sizeof(FileSection) * table.size(), checksum(&header, sizeof(header)));
+
+    std::ofstream stream;
+    stream.open(fileName, std::ofstream::binary);
+    stream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    stream.write(reinterpret_cast<const char *>(table.data()), sizeof(FileSection) * table.size());
+    size_t position = sizeof(FileHeader) + sizeof(FileSection) * sections.size();
+    const char padding[TEXTURE_SECTION_ALIGNMENT] = {};
+    for(size_t i = 0; i < sections.size(); i++)
+    {
+        stream.write(padding, table[i].offset - position);
+        stream.write(static_cast<const char *>(sections[i].data), sections[i].size);
+        position = table[i].offset + table[i].size;
+    }
+    stream.close();
+    if(!stream)
+    {
+        std::cerr << "[Error] " << __FILE__ << ": Line" << __LINE__ << " failed to write " << fileName << std::endl;
+        exit(1);
+    }
+}
+
+void fileFormatError(const char* fileName, const char* reason)
+{
+    std::cerr << "[Error] " << fileName << ": " << reason << std::endl;
+    exit(1);
+}
+
+//FreeType built without ClearType style filtering refuses the filter and renders LCD with its Harmony method
+void setLcdFilter(FT_Library library, AtlasFormat format)
+{
+    if(format == AtlasFormat::LCD)
+    {
+        FT_Library_SetLcdFilter(library, FT_LCD_FILTER_DEFAULT);
+    }
+}
+
+void setDistanceFieldSpread(FT_Library library, unsigned int spread)
+{
+#ifdef HAVE_FREETYPE_SDF
+    if(spread != 0)
+    {
+        FT_UInt value = spread;
+        CHECK_FREETYPE_ERROR(FT_Property_Set(library, "sdf", "spread", &value));
+        CHECK_FREETYPE_ERROR(FT_Property_Set(library, "bsdf", "spread", &value));
+    }
+#else
+    (void)library;
+    (void)spread;
+#endif
+}
+
+//glyphs of the fallback chain are identified by their face and glyph index, glyph 0 of face 0 is the invalid glyph
+FT_UInt glyphKey(unsigned int face, FT_UInt glyph_index)
+{
+    return face << FACE_SHIFT | glyph_index;
+}
+
+//fontFileName first, then the fallback faces
+std::vector<FontFace> fontFaceChain(const char* fontFileName, const TextureFontOptions& options)
+{
+    std::vector<FontFace> faces(1, FontFace{fontFileName, options.faceIndex});
+    faces.insert(faces.end(), options.fallbackFaces.begin(), options.fallbackFaces.end());
+    if(faces.size() > MAX_FACE_NUM)
+    {
+        std::cerr << "[Error] " << __FILE__ << ": Line" << __LINE__ << " a fallback chain has at most " << MAX_FACE_NUM << " faces" << std::endl;
+        exit(1);
+    }
+    return faces;
+}
 
-            tmpLineWidth += m_face->glyph->bitmap.width+BLANK_COLUMN;
-            characterIndex++;
+std::vector<FT_Face> openFaces(FT_Library library, const std::vector<FontFace>& faces, unsigned int pt, unsigned int h_resolution, unsigned int v_resolution)
+{
+    std::vector<FT_Face> openedFaces(faces.size(), nullptr);
+    for(size_t i = 0; i < faces.size(); i++)
+    {
+        CHECK_FREETYPE_ERROR(FT_New_Face(library, faces[i].fileName.c_str(), faces[i].faceIndex, &openedFaces[i]));
+        CHECK_FREETYPE_ERROR(FT_Set_Char_Size(openedFaces[i], 0, pt * 64, h_resolution, v_resolution));
+        if((unsigned long)openedFaces[i]->num_glyphs > GLYPH_INDEX_MASK)
+        {
+            std::cerr << "[Error] " << __FILE__ << ": Line" << __LINE__ << " " << faces[i].fileName << " has too many glyphs" << std::endl;
+            exit(1);
         }
+    }
+    return openedFaces;
+}
 
-        for(unsigned int j = 0; j < tmpMaxLineHeight; j++)
+void closeFaces(std::vector<FT_Face>& faces)
+{
+    for(auto iter = faces.begin(); iter != faces.end(); iter++)
+    {
+        CHECK_FREETYPE_ERROR(FT_Done_Face(*iter));
+    }
+    faces.clear();
+}
+
+//exact squared euclidean distance transform of one row or column (Felzenszwalb & Huttenlocher)
+void distanceTransform1D(float* grid, size_t stride, unsigned int length, std::vector<float>& f, std::vector<unsigned int>& v, std::vector<float>& z)
+{
+    const float inf = 1e20f;
+    f.resize(length);
+    v.resize(length);
+    z.resize(length + 1);
+    for(unsigned int q = 0; q < length; q++)
+    {
+        f[q] = grid[q * stride];
+    }
+    int k = 0;
+    v[0] = 0;
+    z[0] = -inf;
+    z[1] = inf;
+    for(unsigned int q = 1; q < length; q++)
+    {
+        //z[0] is -inf, so k never drops below 0
+        float s;
+        for(;;)
         {
-            for(unsigned int k = 0; k < TEXTURE_WIDTH-tmpLineWidth; k++)
+            unsigned int r = v[k];
+            s = (f[q] - f[r] + (float)q * q - (float)r * r) / (2.0f * ((float)q - r));
+            if(s > z[k])
             {
-                tmpTexture[tmpY+j].push_back(0);
+                break;
             }
+            k--;
         }
-
-        m_textureWidth = TEXTURE_WIDTH;
-        m_textureHeight = tmpY + tmpMaxLineHeight;
+        k++;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = inf;
     }
-
-    m_texture = new unsigned char[m_textureWidth * m_textureHeight];
-    for(unsigned int i = 0; i < m_textureHeight ; i++)
+    k = 0;
+    for(unsigned int q = 0; q < length; q++)
     {
-        for(unsigned int j = 0; j < m_textureWidth; j++)
+        while(z[k + 1] < q)
         {
-            m_texture[i*m_textureWidth+j] = tmpTexture[i][j];
+            k++;
         }
+        float d = (float)q - v[k];
+        grid[q * stride] = f[v[k]] + d * d;
     }
-
-    CHECK_FREETYPE_ERROR(FT_Done_Face(m_face));
-    CHECK_FREETYPE_ERROR(FT_Done_FreeType(m_library));
 }
 
-TextureFont::TextureFont(const char* textureFontFileName)
-    :m_texture(nullptr)
-    ,m_characterMap(nullptr)
+void distanceTransform(std::vector<float>& grid, unsigned int width, unsigned int height)
 {
-    size_t characterInfoSize;
-    std::ifstream stream;
-    stream.open(textureFontFileName, std::ifstream::binary);
+    std::vector<float> f, z;
+    std::vector<unsigned int> v;
+    for(unsigned int x = 0; x < width; x++)
+    {
+        distanceTransform1D(grid.data() + x, width, height, f, v, z);
+    }
+    for(unsigned int y = 0; y < height; y++)
+    {
+        distanceTransform1D(grid.data() + (size_t)y * width, 1, width, f, v, z);
+    }
+}
 
-    stream.read(reinterpret_cast<char *>(&m_textureWidth), sizeof(m_textureWidth));
-    stream.read(reinterpret_cast<char *>(&m_textureHeight), sizeof(m_textureHeight));
-    stream.read(reinterpret_cast<char *>(&m_characterTotalNum), sizeof(m_characterTotalNum));
-    stream.read(reinterpret_cast<char *>(&m_characterInfoInvalidIndex), sizeof(m_characterInfoInvalidIndex));
-    stream.read(reinterpret_cast<char *>(&m_pt), sizeof(m_pt));
-    stream.read(reinterpret_cast<char *>(&characterInfoSize), sizeof(characterInfoSize));
-    std::cout << m_textureWidth << " " << m_textureHeight << " " << m_characterTotalNum << " " << m_characterInfoInvalidIndex << " " << m_pt << " " << characterInfoSize;
-    m_texture = new unsigned char[m_textureWidth * m_textureHeight];
-    m_characterMap = new unsigned int[m_characterTotalNum];
-    stream.read(reinterpret_cast<char *>(m_texture), m_textureWidth * m_textureHeight);
-    for(size_t i = 0; i < characterInfoSize; i++)
+//distance field of the coverage bitmap in FreeType's sdf layout: the glyph grows by spread on every
+//side and 128 is the edge, positive inside. Partially covered pixels place the edge with subpixel
+//precision, which is close to the outline based result at a fraction of its cost
+void coverageToDistanceField(GlyphBitmap& glyph, unsigned int spread)
+{
+    if(glyph.info.width == 0 || glyph.info.height == 0)
     {
-        CharacterInfo tmpInfo;
-        stream.read(reinterpret_cast<char *>(&tmpInfo), sizeof(tmpInfo));
-        m_characterInfo.push_back(tmpInfo);
+        return;
     }
-    stream.read(reinterpret_cast<char *>(m_characterMap), m_characterTotalNum * sizeof(unsigned int));
-    stream.close();
+    const float inf = 1e20f;
+    unsigned int width = glyph.info.width + 2 * spread;
+    unsigned int height = glyph.info.height + 2 * spread;
+    std::vector<float> outer((size_t)width * height, inf);
+    std::vector<float> inner((size_t)width * height, 0.0f);
+    for(unsigned int j = 0; j < glyph.info.height; j++)
+    {
+        for(unsigned int i = 0; i < glyph.info.width; i++)
+        {
+            //partially covered pixels seed both transforms with their subpixel distance to the edge
+            float a = glyph.buffer[j * glyph.info.width + i] / 255.0f;
+            size_t index = (size_t)(j + spread) * width + i + spread;
+            if(a >= 1.0f)
+            {
+                outer[index] = 0.0f;
+                inner[index] = inf;
+            }
+            else if(a > 0.0f)
+            {
+                float d = 0.5f - a;
+                outer[index] = d > 0.0f ? d * d : 0.0f;
+                inner[index] = d < 0.0f ? d * d : 0.0f;
+            }
+        }
+    }
+    distanceTransform(outer, width, height);
+    distanceTransform(inner, width, height);
+    glyph.buffer.resize((size_t)width * height);
+    for(size_t i = 0; i < glyph.buffer.size(); i++)
+    {
+        float distance = std::sqrt(inner[i]) - std::sqrt(outer[i]);
+        float value = 128.0f + distance * 128.0f / spread;
+        glyph.buffer[i] = (unsigned char)std::min(255.0f, std::max(0.0f, value + 0.5f));
+    }
+    glyph.info.width = width;
+    glyph.info.height = height;
+    glyph.info.bitmap_left -= spread;
+    glyph.info.bitmap_top += spread;
 }
 
-TextureFont::~TextureFont()
+//distanceFieldSpread 0 renders coverage, otherwise a signed distance field reaching spread pixels,
+//from the outline by FreeType if freetypeDistanceField and FreeType has the sdf module; key is a glyph key.
+//Phase p of subpixelPositions moves the outline right by p / subpixelPositions pixel, bitmap glyphs stay put.
+//An LCD atlas gets the coverage of every subpixel, grayscale bitmap glyphs are spread over all three
+void renderGlyph(const std::vector<FT_Face>& faces, FT_UInt key, unsigned int phase, unsigned int subpixelPositions,
+                 unsigned int distanceFieldSpread, bool freetypeDistanceField, AtlasFormat format, GlyphBitmap& glyph)
 {
-    if(m_texture)
+    FT_Face face = faces[key >> FACE_SHIFT];
+    //hinting along x would pull the shifted stems back onto the pixel grid
+    FT_Int32 loadFlags = FT_LOAD_DEFAULT;
+    if(subpixelPositions > 1)
+    {
+        loadFlags = FT_LOAD_TARGET_LIGHT;
+    }
+    else if(format == AtlasFormat::LCD)
+    {
+        loadFlags = FT_LOAD_TARGET_LCD;
+    }
+    CHECK_FREETYPE_ERROR(FT_Load_Glyph(face, key & GLYPH_INDEX_MASK, loadFlags));
+    if(phase != 0 && face->glyph->format == FT_GLYPH_FORMAT_OUTLINE)
+    {
+        FT_Outline_Translate(&face->glyph->outline, phase * 64 / subpixelPositions, 0);
+    }
+    FT_Render_Mode renderMode = format == AtlasFormat::LCD ? FT_RENDER_MODE_LCD : FT_RENDER_MODE_NORMAL;
+#ifdef HAVE_FREETYPE_SDF
+    if(distanceFieldSpread != 0 && freetypeDistanceField)
+    {
+        renderMode = FT_RENDER_MODE_SDF;
+    }
+#else
+    freetypeDistanceField = false;
+#endif
+    CHECK_FREETYPE_ERROR(FT_Render_Glyph(face->glyph, renderMode));
+    const FT_Bitmap& bitmap = face->glyph->bitmap;
+    bool lcdBitmap = bitmap.pixel_mode == FT_PIXEL_MODE_LCD;
+    unsigned int width = lcdBitmap ? bitmap.width / 3 : bitmap.width;
+    unsigned int subpixels = format == AtlasFormat::LCD ? 3 : 1;
+    glyph.info.x = 0;
+    glyph.info.y = 0;
+    glyph.info.bitmap_left = face->glyph->bitmap_left;
+    glyph.info.bitmap_top = face->glyph->bitmap_top;
+    glyph.info.width = width;
+    glyph.info.height = bitmap.rows;
+    //linearHoriAdvance is in 1/65536 pixel
+    glyph.info.advance = subpixelPositions > 1 ? (face->glyph->linearHoriAdvance + 512) >> 10 : face->glyph->advance.x;
+    glyph.buffer.resize((size_t)width * subpixels * bitmap.rows);
+    for(unsigned int j = 0; j < bitmap.rows; j++)
     {
-        delete [] m_texture;
-        m_texture = nullptr;
+        const unsigned char* row = bitmap.pitch >= 0 ? bitmap.buffer + j * bitmap.pitch : bitmap.buffer + (bitmap.rows - 1 - j) * -bitmap.pitch;
+        unsigned char* destination = glyph.buffer.data() + (size_t)j * width * subpixels;
+        if(lcdBitmap || subpixels == 1)
+        {
+            memcpy(destination, row, (size_t)width * subpixels);
+        }
+        else
+        {
+            for(unsigned int i = 0; i < width; i++)
+            {
+                destination[i * 3] = destination[i * 3 + 1] = destination[i * 3 + 2] = row[i];
+            }
+        }
     }
-    if(m_characterMap)
+    if(distanceFieldSpread != 0 && !freetypeDistanceField)
     {
-        delete [] m_characterMap;
-        m_characterMap = nullptr;
+        coverageToDistanceField(glyph, distanceFieldSpread);
     }
 }
 
-unsigned int TextureFont::pt() const
+//all variants of one glyph, into variants[0..subpixelPositions - 1]
+void renderGlyphVariants(const std::vector<FT_Face>& faces, FT_UInt key, unsigned int subpixelPositions,
+                         unsigned int distanceFieldSpread, bool freetypeDistanceField, AtlasFormat format, GlyphBitmap* variants)
 {
-    return m_pt;
+    for(unsigned int phase = 0; phase < subpixelPositions; phase++)
+    {
+        renderGlyph(faces, key, phase, subpixelPositions, distanceFieldSpread, freetypeDistanceField, format, variants[phase]);
+    }
 }
 
-unsigned int TextureFont::characterTotalNum() const
+//columns a glyph of width pixels takes in the atlas, including the blank one. Coverage4 rounds it to even:
+//every packer puts rects at sums of the widths before them, so glyphs start at even columns and never
+//share a byte
+unsigned int glyphColumns(unsigned int width, AtlasFormat format)
 {
-    return m_characterTotalNum;
+    unsigned int columns = width + BLANK_COLUMN;
+    return format == AtlasFormat::Coverage4 ? (columns + 1) & ~1u : columns;
 }
 
-unsigned int TextureFont::textureWidth() const
+//the variants of a glyph share one rect, side by side with phase 0 leftmost
+PackRect variantRect(const CharacterInfo* variants, unsigned int subpixelPositions, AtlasFormat format)
 {
-    return m_textureWidth;
+    PackRect rect{0, 0, 0, 0, 0};
+    for(unsigned int phase = 0; phase < subpixelPositions; phase++)
+    {
+        rect.width += glyphColumns(variants[phase].width, format);
+        rect.height = std::max(rect.height, variants[phase].height);
+    }
+    return rect;
 }
 
-unsigned int TextureFont::textureHeight() const
+PackRect variantRect(const GlyphBitmap* variants, unsigned int subpixelPositions, AtlasFormat format)
 {
-    return m_textureHeight;
+    PackRect rect{0, 0, 0, 0, 0};
+    for(unsigned int phase = 0; phase < subpixelPositions; phase++)
+    {
+        rect.width += glyphColumns(variants[phase].info.width, format);
+        rect.height = std::max(rect.height, variants[phase].info.height);
+    }
+    return rect;
 }
 
-CharacterInfo TextureFont::characterInfo(unsigned int unicode) const
+//copies a rendered glyph to info.x, info.y of page; coverageTable maps every byte unless it is empty,
+//for Coverage4 to the 4 bit value
+void writeGlyph(unsigned char* page, size_t rowBytes, AtlasFormat format, const std::vector<unsigned char>& coverageTable,
+                const CharacterInfo& info, const unsigned char* pixels)
 {
-    if(unicode >= m_characterTotalNum)
+    size_t glyphRowBytes = format == AtlasFormat::LCD ? (size_t)info.width * 3 : info.width;
+    for(unsigned int j = 0; j < info.height; j++)
     {
-        return m_characterInfo[m_characterInfoInvalidIndex];
+        const unsigned char* source = pixels + j * glyphRowBytes;
+        unsigned char* destination = page + (size_t)(info.y + j) * rowBytes + atlasRowBytes(format, info.x);
+        if(format == AtlasFormat::Coverage4)
+        {
+            for(unsigned int i = 0; i < info.width; i += 2)
+            {
+                unsigned char right = i + 1 < info.width ? coverageTable[source[i + 1]] : 0;
+                destination[i / 2] = coverageTable[source[i]] | right << 4;
+            }
+        }
+        else if(coverageTable.empty())
+        {
+            memcpy(destination, source, glyphRowBytes);
+        }
+        else
+        {
+            for(size_t i = 0; i < glyphRowBytes; i++)
+            {
+                destination[i] = coverageTable[source[i]];
+            }
+        }
     }
-    else
+}
+
+bool kerningPairLess(const KerningPair& a, const KerningPair& b)
+{
+    return a.left < b.left || (a.left == b.left && a.right < b.right);
+}
+
+//the glyph pairs of the format 0 subtables of the TrueType kern table, keyed by the glyph keys of face
+//number faceNum of the chain, with the values FreeType applies at the current size, rounded to the pixel
+//unless unfitted; kerning that only GPOS has needs a shaper
+std::vector<KerningPair> loadKerningPairs(FT_Face face, unsigned int faceNum, bool unfitted)
+{
+    std::vector<KerningPair> pairs;
+    FT_ULong length = 0;
+    if(!FT_HAS_KERNING(face) || FT_Load_Sfnt_Table(face, TTAG_kern, 0, nullptr, &length) != 0)
+    {
+        return pairs;
+    }
+    std::vector<unsigned char> table(length);
+    CHECK_FREETYPE_ERROR(FT_Load_Sfnt_Table(face, TTAG_kern, 0, table.data(), &length));
+    auto read16 = [&](size_t offset) {
+        return offset + 2 <= length ? (size_t)(table[offset] << 8 | table[offset + 1]) : 0;
+    };
+
+    //version 0 (OpenType) has 16 bit subtable headers, version 1 (Apple) 32 bit ones
+    bool apple = read16(0) == 1;
+    size_t subtableNum = apple ? read16(4) << 16 | read16(6) : read16(2);
+    size_t offset = apple ? 8 : 4;
+    for(size_t t = 0; t < subtableNum && offset < length; t++)
+    {
+        size_t subtableLength = apple ? read16(offset) << 16 | read16(offset + 2) : read16(offset + 2);
+        size_t coverage = read16(offset + 4);
+        size_t headerSize = apple ? 8 : 6;
+        bool horizontalPairs = apple ? (coverage & 0xe0ff) == 0 : (coverage & 0xff07) == 0x0001;
+        if(horizontalPairs)
+        {
+            //the 16 bit length overflows for large subtables, the pair count is trusted as far as the table reaches
+            size_t first = offset + headerSize + 8;
+            size_t pairNum = std::min(read16(offset + headerSize), (length - std::min(first, (size_t)length)) / 6);
+            for(size_t i = 0; i < pairNum; i++)
+            {
+                unsigned int left = read16(first + i * 6);
+                unsigned int right = read16(first + i * 6 + 2);
+                FT_Vector delta;
+                if(FT_Get_Kerning(face, left, right, unfitted ? FT_KERNING_UNFITTED : FT_KERNING_DEFAULT, &delta) == 0 && delta.x != 0)
+                {
+                    pairs.push_back(KerningPair{glyphKey(faceNum, left), glyphKey(faceNum, right), (int)delta.x});
+                }
+            }
+            subtableLength = headerSize + 8 + pairNum * 6;
+        }
+        if(subtableLength == 0)
+        {
+            break;
+        }
+        offset += subtableLength;
+    }
+    std::sort(pairs.begin(), pairs.end(), kerningPairLess);
+    pairs.erase(std::unique(pairs.begin(), pairs.end(), [](const KerningPair& a, const KerningPair& b) {
+        return a.left == b.left && a.right == b.right;
+    }), pairs.end());
+    return pairs;
+}
+
+//the keys of a face are above those of the faces before it, so the pairs stay sorted
+std::vector<KerningPair> loadKerningPairs(const std::vector<FT_Face>& faces, bool unfitted)
+{
+    std::vector<KerningPair> pairs;
+    for(size_t i = 0; i < faces.size(); i++)
     {
-        return m_characterInfo[m_characterMap[unicode]];
+        std::vector<KerningPair> facePairs = loadKerningPairs(faces[i], i, unfitted);
+        pairs.insert(pairs.end(), facePairs.begin(), facePairs.end());
     }
+    return pairs;
 }
 
-TextureCoord TextureFont::textureCoord(unsigned int unicode) const
+//the top bits index the kerning hash and its filter
+uint64_t kerningHash(unsigned int left, unsigned int right)
 {
-    CharacterInfo info = characterInfo(unicode);
-    TextureCoord coord;
-    coord.left = (float)info.x/(float)(m_textureWidth-1);
-    coord.right = (float)(info.x+info.width-1)/(float)(m_textureWidth-1);
-    coord.top = (float)info.y/(float)(m_textureHeight-1);
-    coord.bottom = (float)(info.y+info.height-1)/(float)(m_textureHeight-1);
-    return coord;
+    return ((uint64_t)left << 32 | right) * 0x9e3779b97f4a7c15ull;
 }
 
-void TextureFont::saveToTextureFile(const char* textureFontFileName) const
+FontMetrics sizeFontMetrics(const FT_Size_Metrics& metrics)
 {
-    size_t szCharacterInfo = m_characterInfo.size();
-    std::ofstream stream;
-    stream.open(textureFontFileName, std::ofstream::binary);
-    stream.write(reinterpret_cast<const char *>(&m_textureWidth), sizeof(m_textureWidth));
-    stream.write(reinterpret_cast<const char *>(&m_textureHeight), sizeof(m_textureHeight));
-    stream.write(reinterpret_cast<const char *>(&m_characterTotalNum), sizeof(m_characterTotalNum));
-    stream.write(reinterpret_cast<const char *>(&m_characterInfoInvalidIndex), sizeof(m_characterInfoInvalidIndex));
-    stream.write(reinterpret_cast<const char *>(&m_pt), sizeof(m_pt));
-    stream.write(reinterpret_cast<const char *>(&szCharacterInfo), sizeof(szCharacterInfo));
-    stream.write(reinterpret_cast<const char *>(m_texture), m_textureWidth * m_textureHeight);
-    for(auto iter = m_characterInfo.begin(); iter != m_characterInfo.end(); iter++)
-    {
-        auto tmpChInfo = *iter;
-        stream.write(reinterpret_cast<char *>(&tmpChInfo), sizeof(tmpChInfo));
-    }
-    stream.write(reinterpret_cast<char *>(m_characterMap), m_characterTotalNum * sizeof(unsigned int));
-    stream.close();
+    FontMetrics fontMetrics;
+    fontMetrics.ascender = metrics.ascender / 64.0f;
+    fontMetrics.descender = metrics.descender / 64.0f;
+    fontMetrics.lineHeight = metrics.height / 64.0f;
+    fontMetrics.lineGap = fontMetrics.lineHeight - (fontMetrics.ascender - fontMetrics.descender);
+    return fontMetrics;
 }
 
-const unsigned char* TextureFont::texture() const
+//every worker owns its FT_Library and FT_Faces, glyphs are handed out in chunks so that
+//the dense CJK ranges are spread over all workers; glyphs holds subpixelPositions variants per key
+void renderGlyphsParallel(const std::vector<FontFace>& fontFaces, unsigned int pt, unsigned int h_resolution, unsigned int v_resolution, unsigned int subpixelPositions,
+                          unsigned int distanceFieldSpread, bool freetypeDistanceField, AtlasFormat format, const std::vector<FT_UInt>& glyphKeys,
+                          std::vector<GlyphBitmap>& glyphs, unsigned int threadNum)
 {
-    return m_texture;
+    const size_t chunkSize = 64;
+    std::atomic<size_t> nextChunk(0);
+    std::vector<std::thread> workers;
+    for(unsigned int t = 0; t < threadNum; t++)
+    {
+        workers.emplace_back([&]() {
+            FT_Library library;
+            CHECK_FREETYPE_ERROR(FT_Init_FreeType(&library));
+            setDistanceFieldSpread(library, distanceFieldSpread);
+            setLcdFilter(library, format);
+            std::vector<FT_Face> faces = openFaces(library, fontFaces, pt, h_resolution, v_resolution);
+            for(;;)
+            {
+                size_t begin = nextChunk.fetch_add(chunkSize);
+                if(begin >= glyphKeys.size())
+                {
+                    break;
+                }
+                size_t end = std::min(begin + chunkSize, glyphKeys.size());
+                for(size_t i = begin; i < end; i++)
+                {
+                    renderGlyphVariants(faces, glyphKeys[i], subpixelPositions, distanceFieldSpread, freetypeDistanceField, format, &glyphs[i * subpixelPositions]);
+                }
+            }
+            closeFaces(faces);
+            CHECK_FREETYPE_ERROR(FT_Done_FreeType(library));
+        });
+    }
+    for(auto& worker : workers)
+    {
+        worker.join();
+    }
 }
 
-CharacterImage TextureFont::characterImage(unsigned int unicode) const
+//runs function(i) for every i < count, threadNum threads take the indices one by one
+template<typename Function>
+void parallelFor(size_t count, unsigned int threadNum, Function function)
 {
-    CharacterInfo chinfo = characterInfo(unicode);
-    CharacterImage chimage;
-    chimage.m_width = chinfo.width;
-    chimage.m_height = chinfo.height;
-    chimage.m_bitmap_left = chinfo.bitmap_left;
-    chimage.m_bitmap_top = chinfo.bitmap_top;
-    chimage.m_image = new unsigned char[chinfo.width * chinfo.height];
-    for(unsigned int i = 0; i < chinfo.height; i++)
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+        for(size_t i = next++; i < count; i = next++)
+        {
+            function(i);
+        }
+    };
+    std::vector<std::thread> workers;
+    for(unsigned int t = 1; t < threadNum && t < count; t++)
     {
-        memcpy(chimage.m_image+i*chinfo.width, m_texture+(chinfo.y+i)*TEXTURE_WIDTH+chinfo.x, chinfo.width);
+        workers.emplace_back(work);
     }
-    return chimage;
+    work();
+    for(auto& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+//Compressed texture section: CompressedTextureHeader, blockNum + 1 uint64 offsets of the blocks
+//relative to the section, then the blocks. A block is COMPRESSED_BLOCK_ROWS rows of one page
+//(fewer for the last one of a page), so blocks decode independently and in any order.
+//Coverage is mostly zero, glyph interiors are runs of 0xff and only the edges vary, so a block
+//is a sequence of
+//  0x00..0x3e             1..63 zeros
+//  0x3f lo hi             lo | hi << 8 zeros
+//  0x40..0x7f             1..64 bytes of 0xff
+//  0x80..0xff bytes...    1..128 literal bytes
+struct CompressedTextureHeader
+{
+    uint32_t blockRows;
+    uint32_t blockNum;
+};
+
+size_t runLength(const unsigned char* source, size_t size, unsigned char value, size_t maxLength)
+{
+    size_t length = 0;
+    while(length < size && length < maxLength && source[length] == value)
+    {
+        length++;
+    }
+    return length;
+}
+
+void encodeBlock(const unsigned char* source, size_t size, std::vector<unsigned char>& block)
+{
+    size_t i = 0;
+    while(i < size)
+    {
+        size_t zeros = runLength(source + i, size - i, 0, 0xffff);
+        if(zeros > 0)
+        {
+            if(zeros < 0x40)
+            {
+                block.push_back(zeros - 1);
+            }
+            else
+            {
+                block.push_back(0x3f);
+                block.push_back(zeros & 0xff);
+                block.push_back(zeros >> 8);
+            }
+            i += zeros;
+            continue;
+        }
+        size_t full = runLength(source + i, size - i, 0xff, 0x40);
+        if(full >= 3)
+        {
+            block.push_back(0x3f + full);
+            i += full;
+            continue;
+        }
+        //single zeros and short 0xff runs between edge pixels are cheaper as literals; source[i] isn't
+        //zero and doesn't start a run, so there is at least one
+        size_t literals = 0;
+        while(i + literals < size && literals < 0x80
+              && runLength(source + i + literals, size - i - literals, 0, 2) < 2
+              && runLength(source + i + literals, size - i - literals, 0xff, 3) < 3)
+        {
+            literals++;
+        }
+        block.push_back(0x7f + literals);
+        block.insert(block.end(), source + i, source + i + literals);
+        i += literals;
+    }
+}
+
+bool decodeBlock(const unsigned char* block, size_t blockSize, unsigned char* destination, size_t size)
+{
+    const unsigned char* end = block + blockSize;
+    size_t i = 0;
+    while(block < end)
+    {
+        size_t token = *block++;
+        size_t count;
+        int value;
+        if(token < 0x3f)
+        {
+            count = token + 1;
+            value = 0;
+        }
+        else if(token == 0x3f)
+        {
+            if(end - block < 2)
+            {
+                return false;
+            }
+            count = block[0] | (block[1] << 8);
+            value = 0;
+            block += 2;
+        }
+        else if(token < 0x80)
+        {
+            count = token - 0x3f;
+            value = 0xff;
+        }
+        else
+        {
+            count = token - 0x7f;
+            if(count > (size_t)(end - block) || count > size - i)
+            {
+                return false;
+            }
+            if(end - block >= 0x80 && size - i >= 0x80)
+            {
+                //most tokens are a few pixels: a fixed size copy compiles to a handful of vector
+                //stores instead of a library call, the excess is overwritten by the following tokens
+                memcpy(destination + i, block, 0x80);
+            }
+            else
+            {
+                memcpy(destination + i, block, count);
+            }
+            block += count;
+            i += count;
+            continue;
+        }
+        if(count > size - i)
+        {
+            return false;
+        }
+        if(count <= 0x40 && size - i >= 0x40)
+        {
+            memset(destination + i, value, 0x40);
+        }
+        else
+        {
+            memset(destination + i, value, count);
+        }
+        i += count;
+    }
+    return i == size;
+}
+
+std::vector<unsigned char> encodeCompressedTexture(const unsigned char* texture, size_t rowBytes, unsigned int height, unsigned int pageNum)
+{
+    unsigned int blocksPerPage = (height + COMPRESSED_BLOCK_ROWS - 1) / COMPRESSED_BLOCK_ROWS;
+    std::vector<std::vector<unsigned char> > blocks((size_t)blocksPerPage * pageNum);
+    parallelFor(blocks.size(), std::max(1u, std::thread::hardware_concurrency()), [&](size_t i) {
+        unsigned int page = i / blocksPerPage;
+        unsigned int row = (i % blocksPerPage) * COMPRESSED_BLOCK_ROWS;
+        unsigned int rows = std::min(height - row, (unsigned int)COMPRESSED_BLOCK_ROWS);
+        encodeBlock(texture + ((size_t)page * height + row) * rowBytes, (size_t)rows * rowBytes, blocks[i]);
+    });
+
+    CompressedTextureHeader header;
+    header.blockRows = COMPRESSED_BLOCK_ROWS;
+    header.blockNum = blocks.size();
+    std::vector<uint64_t> offsets(blocks.size() + 1);
+    offsets[0] = sizeof(header) + sizeof(uint64_t) * offsets.size();
+    for(size_t i = 0; i < blocks.size(); i++)
+    {
+        offsets[i + 1] = offsets[i] + blocks[i].size();
+    }
+    std::vector<unsigned char> section(offsets.back());
+    memcpy(section.data(), &header, sizeof(header));
+    memcpy(section.data() + sizeof(header), offsets.data(), sizeof(uint64_t) * offsets.size());
+    for(size_t i = 0; i < blocks.size(); i++)
+    {
+        memcpy(section.data() + offsets[i], blocks[i].data(), blocks[i].size());
+    }
+    return section;
+}
+
+//decodes the blocks in parallel straight into texture, returns false on a damaged section
+bool decodeCompressedTexture(const unsigned char* section, size_t sectionSize, unsigned char* texture,
+                       size_t rowBytes, unsigned int height, unsigned int pageNum)
+{
+    CompressedTextureHeader header;
+    if(sectionSize < sizeof(header))
+    {
+        return false;
+    }
+    memcpy(&header, section, sizeof(header));
+    if(header.blockRows == 0)
+    {
+        return false;
+    }
+    size_t blocksPerPage = (height + header.blockRows - 1) / header.blockRows;
+    if(header.blockNum != blocksPerPage * pageNum || sizeof(header) + sizeof(uint64_t) * (header.blockNum + 1) > sectionSize)
+    {
+        return false;
+    }
+    std::vector<uint64_t> offsets(header.blockNum + 1);
+    memcpy(offsets.data(), section + sizeof(header), sizeof(uint64_t) * offsets.size());
+    for(size_t i = 0; i < header.blockNum; i++)
+    {
+        if(offsets[i] > offsets[i + 1] || offsets[i + 1] > sectionSize)
+        {
+            return false;
+        }
+    }
+    std::atomic<bool> valid(true);
+    parallelFor(header.blockNum, std::max(1u, std::thread::hardware_concurrency()), [&](size_t i) {
+        unsigned int page = i / blocksPerPage;
+        unsigned int row = (i % blocksPerPage) * header.blockRows;
+        unsigned int rows = std::min(height - row, header.blockRows);
+        if(!decodeBlock(section + offsets[i], offsets[i + 1] - offsets[i],
+                        texture + ((size_t)page * height + row) * rowBytes, (size_t)rows * rowBytes))
+        {
+            valid = false;
+        }
+    });
+    return valid;
+}
+
+//grows the dirty rectangle of page to cover the region, one rectangle per page
+void mergeDirtyRect(std::vector<DirtyRect>& dirtyRects, unsigned int page, unsigned int x, unsigned int y, unsigned int width, unsigned int height)
+{
+    if(width == 0 || height == 0)
+    {
+        return;
+    }
+    auto dirty = std::find_if(dirtyRects.begin(), dirtyRects.end(), [page](const DirtyRect& rect) {
+        return rect.page == page;
+    });
+    if(dirty == dirtyRects.end())
+    {
+        dirtyRects.push_back(DirtyRect{page, x, y, width, height});
+        return;
+    }
+    unsigned int right = std::max(dirty->x + dirty->width, x + width);
+    unsigned int bottom = std::max(dirty->y + dirty->height, y + height);
+    dirty->x = std::min(dirty->x, x);
+    dirty->y = std::min(dirty->y, y);
+    dirty->width = right - dirty->x;
+    dirty->height = bottom - dirty->y;
+}
+}
+
+struct TextureFont::GlyphCache
+{
+    GlyphCache(PackingStrategy strategy, unsigned int pageNumLimit)
+        :packingStrategy(strategy)
+        ,maxPageNum(pageNumLimit)
+        ,packerPage(0)
+        ,stats{0, 0, 0}
+    {
+
+    }
+
+    void markDirty(unsigned int page, unsigned int x, unsigned int y, unsigned int width, unsigned int height)
+    {
+        mergeDirtyRect(dirtyRects, page, x, y, width, height);
+    }
+
+    PackingStrategy packingStrategy;
+    unsigned int maxPageNum;
+    std::unique_ptr<AtlasPacker> packer;
+    unsigned int packerPage;
+    std::unordered_map<FT_UInt, unsigned int> glyphIndexMap;  //by glyph key
+    std::vector<DirtyRect> dirtyRects;
+
+    //per slot of m_characterInfo
+    std::vector<PackRect> slotRects;  //the region the slot owns, may be larger than its current glyph
+    std::vector<FT_UInt> slotGlyphIndex;  //glyph key
+    std::vector<std::vector<unsigned int> > slotCharacters;
+    std::vector<std::list<unsigned int>::iterator> lruPosition;  //lru.end() for pinned slots
+
+    std::list<unsigned int> lru;  //most recently used first
+    std::vector<unsigned int> freeSlots;
+    std::vector<unsigned int> evictedCharacters;
+    GlyphCacheStats stats;
+};
+
+//the workers only write glyphs and then flag their chunk, everything else belongs to the thread
+//that publishes, so the lookups need no synchronization at all
+struct TextureFont::BackgroundBuild
+{
+    BackgroundBuild(PackingStrategy strategy, const std::vector<FT_UInt>& keys, unsigned int subpixelPositions)
+        :packingStrategy(strategy)
+        ,glyphKeys(keys)
+        ,glyphs(keys.size() * subpixelPositions)
+        ,chunkNum((keys.size() - 1 + BUILD_CHUNK_SIZE - 1) / BUILD_CHUNK_SIZE)
+        ,chunkDone(new std::atomic<bool>[chunkNum])
+        ,nextChunk(0)
+        ,renderedGlyphNum(0)
+        ,stop(false)
+        ,publishedChunkNum(0)
+        ,packerPage(0)
+    {
+        for(size_t i = 0; i < chunkNum; i++)
+        {
+            chunkDone[i].store(false, std::memory_order_relaxed);
+        }
+    }
+
+    ~BackgroundBuild()
+    {
+        stop.store(true);
+        joinWorkers();
+    }
+
+    void joinWorkers()
+    {
+        for(auto& worker : workers)
+        {
+            worker.join();
+        }
+        workers.clear();
+    }
+
+    //chunk i holds the glyphs 1 + i * BUILD_CHUNK_SIZE onwards, glyph 0 is published up front
+    PackingStrategy packingStrategy;
+    std::vector<FT_UInt> glyphKeys;  //per glyph, its slot is the index times the subpixel positions
+    std::vector<GlyphBitmap> glyphs;    //per variant, i.e. per slot of m_characterInfo, released when published
+    size_t chunkNum;
+    std::unique_ptr<std::atomic<bool>[]> chunkDone;
+    std::atomic<size_t> nextChunk;
+    std::atomic<size_t> renderedGlyphNum;
+    std::atomic<bool> stop;
+    std::vector<std::thread> workers;
+
+    size_t publishedChunkNum;
+    std::unique_ptr<AtlasPacker> packer;
+    unsigned int packerPage;
+    std::vector<DirtyRect> dirtyRects;
+};
+
+TextureFontOptions::TextureFontOptions()
+    :threadNum(1)
+    ,faceIndex(0)
+    ,packingStrategy(PackingStrategy::Shelf)
+    ,sortByHeight(false)
+    ,maxTextureSize(0)
+    ,dynamicAtlas(false)
+    ,dynamicPageSize(DEFAULT_DYNAMIC_PAGE_SIZE)
+    ,maxPageNum(0)
+    ,signedDistanceField(false)
+    ,distanceFieldSpread(DEFAULT_DISTANCE_FIELD_SPREAD)
+    ,freetypeDistanceField(false)
+    ,backgroundBuild(false)
+    ,subpixelPositions(1)
+    ,atlasFormat(AtlasFormat::Coverage8)
+    ,coverageGamma(1.0f)
+    ,eacTexture(false)
+{
+
+}
+
+TextureFont::TextureFont(const char* fontFileName, unsigned int pt, unsigned int h_resolution, unsigned int v_resolution, const TextureFontOptions& options)
+    :m_library(nullptr)
+    ,m_texture(nullptr)
+    ,m_textureWidth(0)
+    ,m_textureHeight(0)
+    ,m_pageNum(0)
+    ,m_characterTotalNum(0)
+    ,m_characterInfoInvalidIndex(0)
+    ,m_pt(0)
+    ,m_distanceFieldSpread(0)
+    ,m_freetypeDistanceField(false)
+    ,m_characterSet()
+    ,m_subpixelPositions(1)
+    ,m_atlasFormat(AtlasFormat::Coverage8)
+    ,m_fontMetrics{0.0f, 0.0f, 0.0f, 0.0f}
+    ,m_characterInfo(nullptr)
+    ,m_characterInfoNum(0)
+    ,m_characterBlockIndex(nullptr)
+    ,m_characterBlocks(nullptr)
+    ,m_characterBlockNum(0)
+    ,m_kerningPairs(nullptr)
+    ,m_kerningPairNum(0)
+    ,m_kerningHashBits(0)
+    ,m_compressedTexture(nullptr)
+    ,m_compressedTextureSize(0)
+    ,m_eacTexture(nullptr)
+    ,m_mapping(nullptr)
+    ,m_mappingSize(0)
+    ,m_atlasGeneration(0)
+{
+    if(options.signedDistanceField)
+    {
+        if(options.distanceFieldSpread < MIN_DISTANCE_FIELD_SPREAD || options.distanceFieldSpread > MAX_DISTANCE_FIELD_SPREAD)
+        {
+            std::cerr << "[Error] " << __FILE__ << ": Line" << __LINE__ << " distanceFieldSpread has to be in [" << MIN_DISTANCE_FIELD_SPREAD << ", " << MAX_DISTANCE_FIELD_SPREAD << "]" << std::endl;
+            exit(1);
+        }
+        m_distanceFieldSpread = options.distanceFieldSpread;
+        m_freetypeDistanceField = options.freetypeDistanceField;
+    }
+    if(options.subpixelPositions < 1 || options.subpixelPositions > MAX_SUBPIXEL_POSITIONS)
+    {
+        std::cerr << "[Error] " << __FILE__ << ": Line" << __LINE__ << " subpixelPositions has to be in [1, " << MAX_SUBPIXEL_POSITIONS << "]" << std::endl;
+        exit(1);
+    }
+    m_subpixelPositions = options.subpixelPositions;
+    if(options.signedDistanceField && (options.atlasFormat != AtlasFormat::Coverage8 || options.coverageGamma != 1.0f))
+    {
+        std::cerr << "[Error] " << __FILE__ << ": Line" << __LINE__ << " distance fields need the coverage8 atlas format and a coverageGamma of 1" << std::endl;
+        exit(1);
+    }
+    if(!(options.coverageGamma >= MIN_COVERAGE_GAMMA && options.coverageGamma <= MAX_COVERAGE_GAMMA))
+    {
+        std::cerr << "[Error] " << __FILE__ << ": Line" << __LINE__ << " coverageGamma has to be in [" << MIN_COVERAGE_GAMMA << ", " << MAX_COVERAGE_GAMMA << "]" << std::endl;
+        exit(1);
+    }
+    if(options.eacTexture && (options.dynamicAtlas || options.backgroundBuild || options.atlasFormat != AtlasFormat::Coverage8))
+    {
+        std::cerr << "[Error] " << __FILE__ << ": Line" << __LINE__ << " the EAC texture needs a static coverage8 atlas built in the constructor" << std::endl;
+        exit(1);
+    }
+    m_atlasFormat = options.atlasFormat;
+    //the value every coverage byte is written as, a plain copy needs no table
+    if(m_atlasFormat == AtlasFormat::Coverage4 || options.coverageGamma != 1.0f)
+    {
+        unsigned int maximum = m_atlasFormat == AtlasFormat::Coverage4 ? 15 : 255;
+        m_coverageTable.resize(256);
+        for(unsigned int value = 0; value < 256; value++)
+        {
+            double coverage = std::pow(value / 255.0, 1.0 / options.coverageGamma);
+            m_coverageTable[value] = (unsigned char)std::lround(coverage * maximum);
+        }
+    }
+    CHECK_FREETYPE_ERROR(FT_Init_FreeType(&m_library));
+    setDistanceFieldSpread(m_library, m_distanceFieldSpread);
+    setLcdFilter(m_library, m_atlasFormat);
+    m_characterSet = options.characterSet;
+    std::vector<FontFace> faces = fontFaceChain(fontFileName, options);
+    m_faces = openFaces(m_library, faces, pt, h_resolution, v_resolution);
+    m_pt = pt;
+    m_fontMetrics = sizeFontMetrics(m_faces[0]->size->metrics);
+
+    //walk the whole cmaps, every code point without a glyph, or outside the subset, keeps pointing into the shared block 0
+    std::vector<std::pair<unsigned int, FT_UInt> > characters;
+    for(size_t i = 0; i < m_faces.size(); i++)
+    {
+        FT_UInt glyph_index;
+        FT_ULong charcode = FT_Get_First_Char(m_faces[i], &glyph_index);
+        while(glyph_index != 0 && charcode < UNICODE_CODE_POINT_NUM)
+        {
+            if(m_characterSet.empty() || m_characterSet.contains(charcode))
+            {
+                characters.push_back(std::make_pair((unsigned int)charcode, glyphKey(i, glyph_index)));
+            }
+            charcode = FT_Get_Next_Char(m_faces[i], charcode, &glyph_index);
+        }
+    }
+    if(m_faces.size() > 1)
+    {
+        //the first face of the chain that has a code point wins
+        std::stable_sort(characters.begin(), characters.end(), [](const std::pair<unsigned int, FT_UInt>& a, const std::pair<unsigned int, FT_UInt>& b) {
+            return a.first < b.first;
+        });
+        characters.erase(std::unique(characters.begin(), characters.end(), [](const std::pair<unsigned int, FT_UInt>& a, const std::pair<unsigned int, FT_UInt>& b) {
+            return a.first == b.first;
+        }), characters.end());
+    }
+    m_characterTotalNum = characters.size();
+    m_characterBlockIndexStorage.assign(UNICODE_CODE_POINT_NUM >> CHARACTER_BLOCK_BITS, 0);
+
+    if(options.dynamicAtlas)
+    {
+        //only the invalid glyph is rendered up front, the face stays open for the lookups
+        m_textureWidth = options.dynamicPageSize;
+        if(options.maxTextureSize != 0 && options.maxTextureSize < m_textureWidth)
+        {
+            m_textureWidth = options.maxTextureSize;
+        }
+        m_textureHeight = m_textureWidth;
+        m_characterBlocksStorage.assign(CHARACTER_BLOCK_SIZE, UNRESOLVED_CHARACTER);
+        updateViews();
+        m_kerningPairStorage = loadKerningPairs(m_faces, m_subpixelPositions > 1);
+        m_kerningPairs = m_kerningPairStorage.data();
+        m_kerningPairNum = m_kerningPairStorage.size();
+        buildKerningHash();
+        m_glyphCache.reset(new GlyphCache(options.packingStrategy, options.maxPageNum));
+        addPage();
+        std::vector<GlyphBitmap> variants(m_subpixelPositions);
+        renderGlyphVariants(m_faces, 0, m_subpixelPositions, m_distanceFieldSpread, m_freetypeDistanceField, m_atlasFormat, variants.data());
+        m_characterInfoInvalidIndex = insertGlyph(0, variants.data(), true);
+        updateGlyphLayout();
+        return;
+    }
+
+    //slot 0 is the invalid glyph, code points sharing a glyph share its slot; the slots of the
+    //glyphKeys[i] are i * m_subpixelPositions onwards
+    std::vector<FT_UInt> glyphKeys(1, 0);
+    std::unordered_map<FT_UInt, unsigned int> glyphSlots;
+    {
+        m_characterInfoInvalidIndex = 0;
+        m_characterBlocksStorage.assign(CHARACTER_BLOCK_SIZE, m_characterInfoInvalidIndex);
+        updateViews();
+        glyphSlots[0] = 0;
+        for(auto iter = characters.begin(); iter != characters.end(); iter++)
+        {
+            auto slot = glyphSlots.insert(std::make_pair(iter->second, (unsigned int)glyphKeys.size() * m_subpixelPositions));
+            if(slot.second)
+            {
+                glyphKeys.push_back(iter->second);
+            }
+            setCharacterIndex(iter->first, slot.first->second);
+        }
+    }
+
+    //kerning of glyphs that no code point maps to is dropped
+    {
+        std::vector<KerningPair> pairs = loadKerningPairs(m_faces, m_subpixelPositions > 1);
+        for(auto iter = pairs.begin(); iter != pairs.end(); iter++)
+        {
+            auto left = glyphSlots.find(iter->left);
+            auto right = glyphSlots.find(iter->right);
+            if(left != glyphSlots.end() && right != glyphSlots.end())
+            {
+                m_kerningPairStorage.push_back(KerningPair{left->second, right->second, iter->value});
+            }
+        }
+        std::sort(m_kerningPairStorage.begin(), m_kerningPairStorage.end(), kerningPairLess);
+        m_kerningPairs = m_kerningPairStorage.data();
+        m_kerningPairNum = m_kerningPairStorage.size();
+        buildKerningHash();
+    }
+
+    if(options.backgroundBuild)
+    {
+        startBackgroundBuild(faces, h_resolution, v_resolution, glyphKeys, options);
+        return;
+    }
+
+    //one per slot
+    std::vector<GlyphBitmap> glyphs(glyphKeys.size() * m_subpixelPositions);
+    unsigned int threadNum = options.threadNum;
+    if(threadNum == 0)
+    {
+        threadNum = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if(threadNum > 1 && glyphKeys.size() > 1)
+    {
+        renderGlyphsParallel(faces, pt, h_resolution, v_resolution, m_subpixelPositions, m_distanceFieldSpread, m_freetypeDistanceField, m_atlasFormat,
+                                 glyphKeys, glyphs, threadNum);
+    }
+    else
+    {
+        for(size_t i = 0; i < glyphKeys.size(); i++)
+        {
+            renderGlyphVariants(m_faces, glyphKeys[i], m_subpixelPositions, m_distanceFieldSpread, m_freetypeDistanceField, m_atlasFormat,
+                                &glyphs[i * m_subpixelPositions]);
+        }
+    }
+
+    {
+        unsigned int textureWidth = TEXTURE_WIDTH;
+        if(options.maxTextureSize != 0 && options.maxTextureSize < textureWidth)
+        {
+            textureWidth = options.maxTextureSize;
+        }
+        std::vector<PackRect> rects(glyphKeys.size());
+        for(size_t i = 0; i < glyphKeys.size(); i++)
+        {
+            rects[i] = variantRect(&glyphs[i * m_subpixelPositions], m_subpixelPositions, m_atlasFormat);
+            if(rects[i].width > textureWidth) {
+                std::cerr << "[Error] " << __FILE__ << ": Line" << __LINE__ << " the packed rectangle of every subpixel variant is " << rects[i].width << " pixels wide, wider than the " << textureWidth << " pixel texture" << std::endl;
+                exit(1);
+            }
+        }
+        PackingReport report = packRects(rects, options.packingStrategy, options.sortByHeight, textureWidth, options.maxTextureSize);
+
+        m_characterInfoStorage.reserve(glyphs.size());
+        for(size_t i = 0; i < glyphs.size(); i++)
+        {
+            const PackRect& rect = rects[i / m_subpixelPositions];
+            CharacterInfo tmpInfo = glyphs[i].info;
+            tmpInfo.x = i % m_subpixelPositions == 0 ? rect.x + BLANK_COLUMN
+                                                     : m_characterInfoStorage.back().x + glyphColumns(m_characterInfoStorage.back().width, m_atlasFormat);
+            tmpInfo.y = rect.y;
+            tmpInfo.page = rect.page;
+            m_characterInfoStorage.push_back(tmpInfo);
+        }
+
+        m_textureWidth = report.textureWidth;
+        m_textureHeight = report.textureHeight;
+        m_pageNum = report.pageNum;
+    }
+
+    //the layout is known before any pixel is written, so the atlas is allocated once and
+    //every glyph row is a single block copy; staging bitmaps are released as they are consumed
+    m_textureStorage.assign(textureRowBytes() * m_textureHeight * m_pageNum, 0);
+    for(size_t i = 0; i < glyphs.size(); i++)
+    {
+        const CharacterInfo& tmpInfo = m_characterInfoStorage[i];
+        unsigned char* page = m_textureStorage.data() + (size_t)tmpInfo.page * textureRowBytes() * m_textureHeight;
+        writeGlyph(page, textureRowBytes(), m_atlasFormat, m_coverageTable, tmpInfo, glyphs[i].buffer.data());
+        std::vector<unsigned char>().swap(glyphs[i].buffer);
+    }
+    updateViews();
+    updateGlyphLayout();
+
+    //tiles of block rows are independent, the threads take them one by one
+    if(options.eacTexture)
+    {
+        unsigned int blockRowNum = (m_textureHeight + EAC_BLOCK_SIZE - 1) / EAC_BLOCK_SIZE;
+        unsigned int tilesPerPage = (blockRowNum + EAC_TILE_BLOCK_ROWS - 1) / EAC_TILE_BLOCK_ROWS;
+        m_eacTextureStorage.resize(eacPageBytes() * m_pageNum);
+        parallelFor((size_t)tilesPerPage * m_pageNum, threadNum, [&](size_t tile) {
+            unsigned int page = tile / tilesPerPage;
+            unsigned int firstBlockRow = tile % tilesPerPage * EAC_TILE_BLOCK_ROWS;
+            encodeEacR11(texture(page), m_textureWidth, m_textureWidth, m_textureHeight, firstBlockRow,
+                         std::min(blockRowNum - firstBlockRow, (unsigned int)EAC_TILE_BLOCK_ROWS),
+                         m_eacTextureStorage.data() + eacPageBytes() * page + eacBlockRowBytes(m_textureWidth) * firstBlockRow);
+        });
+        m_eacTexture = m_eacTextureStorage.data();
+    }
+
+    closeFaces(m_faces);
+    CHECK_FREETYPE_ERROR(FT_Done_FreeType(m_library));
+    m_library = nullptr;
+}
+
+TextureFont::TextureFont(const char* textureFontFileName, bool verifyPayload)
+    :m_library(nullptr)
+    ,m_texture(nullptr)
+    ,m_subpixelPositions(1)
+    ,m_atlasFormat(AtlasFormat::Coverage8)
+    ,m_characterInfo(nullptr)
+    ,m_characterInfoNum(0)
+    ,m_characterBlockIndex(nullptr)
+    ,m_characterBlocks(nullptr)
+    ,m_characterBlockNum(0)
+    ,m_kerningPairs(nullptr)
+    ,m_kerningPairNum(0)
+    ,m_kerningHashBits(0)
+    ,m_compressedTexture(nullptr)
+    ,m_compressedTextureSize(0)
+    ,m_eacTexture(nullptr)
+    ,m_mapping(nullptr)
+    ,m_mappingSize(0)
+    ,m_atlasGeneration(0)
+{
+    //the mapping is shared read-only, so several processes loading the same font share its pages
+    int fd = open(textureFontFileName, O_RDONLY);
+    if(fd < 0)
+    {
+        fileFormatError(textureFontFileName, "cannot be opened");
+    }
+    struct stat fileStat;
+    if(fstat(fd, &fileStat) != 0 || (size_t)fileStat.st_size < sizeof(FileHeader))
+    {
+        close(fd);
+        fileFormatError(textureFontFileName, "is too short for a texture font file");
+    }
+    m_mappingSize = fileStat.st_size;
+    m_mapping = mmap(nullptr, m_mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(m_mapping == MAP_FAILED)
+    {
+        m_mapping = nullptr;
+        fileFormatError(textureFontFileName, "cannot be mapped");
+    }
+    const unsigned char* file = static_cast<const unsigned char*>(m_mapping);
+
+    FileHeader header;
+    memcpy(&header, file, sizeof(header));
+    if(header.magic != TEXTURE_FONT_FILE_MAGIC)
+    {
+        fileFormatError(textureFontFileName, "is not a texture font file");
+    }
+    if(header.version != TEXTURE_FONT_FILE_VERSION || header.characterInfoSize != sizeof(CharacterInfo))
+    {
+        fileFormatError(textureFontFileName, "has an unsupported version, bake it again");
+    }
+    if(header.fileSize != m_mappingSize || header.sectionNum > (m_mappingSize - sizeof(FileHeader)) / sizeof(FileSection))
+    {
+        fileFormatError(textureFontFileName, "is truncated");
+    }
+    const FileSection* sections = reinterpret_cast<const FileSection*>(file + sizeof(FileHeader));
+    uint64_t headerChecksum = header.headerChecksum;
+    header.headerChecksum = 0;
+    if(checksum(sections, sizeof(FileSection) * header.sectionNum, checksum(&header, sizeof(header))) != headerChecksum)
+    {
+        fileFormatError(textureFontFileName, "has a damaged header");
+    }
+
+    m_textureWidth = header.textureWidth;
+    m_textureHeight = header.textureHeight;
+    m_pageNum = header.pageNum;
+    m_characterTotalNum = header.characterTotalNum;
+    m_characterInfoInvalidIndex = header.characterInfoInvalidIndex;
+    m_pt = header.pt;
+    m_distanceFieldSpread = header.distanceFieldSpread;
+    m_freetypeDistanceField = false;
+    m_fontMetrics.ascender = header.ascender / 64.0f;
+    m_fontMetrics.descender = header.descender / 64.0f;
+    m_fontMetrics.lineGap = header.lineGap / 64.0f;
+    m_fontMetrics.lineHeight = m_fontMetrics.ascender - m_fontMetrics.descender + m_fontMetrics.lineGap;
+
+    size_t textureSize = 0;
+    size_t eacTextureSize = 0;
+    size_t blockIndexSize = (UNICODE_CODE_POINT_NUM >> CHARACTER_BLOCK_BITS) * sizeof(unsigned int);
+    size_t blockSize = CHARACTER_BLOCK_SIZE * sizeof(unsigned int);
+    const unsigned char* compressedTexture = nullptr;
+    size_t compressedTextureSize = 0;
+    const CharacterRange* characterRanges = nullptr;
+    size_t characterRangeNum = 0;
+    uint64_t payloadChecksum = checksum(nullptr, 0);
+    for(unsigned int i = 0; i < header.sectionNum; i++)
+    {
+        const FileSection& section = sections[i];
+        if(section.offset > m_mappingSize || section.size > m_mappingSize - section.offset)
+        {
+            fileFormatError(textureFontFileName, "has a section outside of the file");
+        }
+        const unsigned char* data = file + section.offset;
+        if(verifyPayload)
+        {
+            payloadChecksum = checksum(data, section.size, payloadChecksum);
+        }
+        switch(section.tag)
+        {
+        case SECTION_TEXTURE:
+            //checked against the size once the atlas format is known
+            textureSize = section.size;
+            m_texture = data;
+            break;
+        case SECTION_COMPRESSED_TEXTURE:
+            compressedTexture = data;
+            compressedTextureSize = section.size;
+            break;
+        case SECTION_CHARACTER_INFO:
+            if(section.size % sizeof(CharacterInfo) != 0 || section.offset % alignof(CharacterInfo) != 0)
+            {
+                fileFormatError(textureFontFileName, "has a damaged character table");
+            }
+            m_characterInfo = reinterpret_cast<const CharacterInfo*>(data);
+            m_characterInfoNum = section.size / sizeof(CharacterInfo);
+            break;
+        case SECTION_BLOCK_INDEX:
+            if(section.size != blockIndexSize || section.offset % alignof(unsigned int) != 0)
+            {
+                fileFormatError(textureFontFileName, "has a damaged code point map");
+            }
+            m_characterBlockIndex = reinterpret_cast<const unsigned int*>(data);
+            break;
+        case SECTION_BLOCKS:
+            if(section.size == 0 || section.size % blockSize != 0 || section.offset % alignof(unsigned int) != 0)
+            {
+                fileFormatError(textureFontFileName, "has a damaged code point map");
+            }
+            m_characterBlocks = reinterpret_cast<const unsigned int*>(data);
+            m_characterBlockNum = section.size / blockSize;
+            break;
+        case SECTION_KERNING_PAIRS:
+            if(section.size % sizeof(KerningPair) != 0 || section.offset % alignof(KerningPair) != 0)
+            {
+                fileFormatError(textureFontFileName, "has a damaged kerning table");
+            }
+            m_kerningPairs = reinterpret_cast<const KerningPair*>(data);
+            m_kerningPairNum = section.size / sizeof(KerningPair);
+            break;
+        case SECTION_CHARACTER_SET:
+            if(section.size % sizeof(CharacterRange) != 0 || section.offset % alignof(CharacterRange) != 0)
+            {
+                fileFormatError(textureFontFileName, "has a damaged character set");
+            }
+            characterRanges = reinterpret_cast<const CharacterRange*>(data);
+            characterRangeNum = section.size / sizeof(CharacterRange);
+            break;
+        case SECTION_SUBPIXEL_POSITIONS:
+            //without it the font has one variant per glyph, readers that skip it draw phase 0 only
+            if(section.size != sizeof(uint32_t))
+            {
+                fileFormatError(textureFontFileName, "has a damaged subpixel position count");
+            }
+            memcpy(&m_subpixelPositions, data, sizeof(uint32_t));
+            break;
+        case SECTION_ATLAS_FORMAT:
+        {
+            //without it the atlas is coverage8; readers that skip it reject the texture by its size
+            uint32_t format;
+            if(section.size != sizeof(uint32_t) || (memcpy(&format, data, sizeof(uint32_t)), format > (uint32_t)AtlasFormat::LCD))
+            {
+                fileFormatError(textureFontFileName, "has an unknown atlas format");
+            }
+            m_atlasFormat = (AtlasFormat)format;
+            break;
+        }
+        case SECTION_EAC_TEXTURE:
+            eacTextureSize = section.size;
+            m_eacTexture = data;
+            break;
+        default:
+            break;
+        }
+    }
+    if(verifyPayload && payloadChecksum != header.payloadChecksum)
+    {
+        fileFormatError(textureFontFileName, "has a damaged payload");
+    }
+    if(!m_texture)
+    {
+        //decoded on first use, copyTexture() can decode straight into an upload buffer instead
+        m_compressedTexture = compressedTexture;
+        m_compressedTextureSize = compressedTextureSize;
+    }
+    if((!m_texture && !m_compressedTexture) || !m_characterInfo || !m_characterBlockIndex || !m_characterBlocks)
+    {
+        fileFormatError(textureFontFileName, "is missing a section");
+    }
+    if(m_texture && textureSize != textureRowBytes() * m_textureHeight * m_pageNum)
+    {
+        fileFormatError(textureFontFileName, "has a texture that doesn't match its size");
+    }
+    if(m_distanceFieldSpread != 0 && m_atlasFormat != AtlasFormat::Coverage8)
+    {
+        fileFormatError(textureFontFileName, "has distance fields in an atlas format other than coverage8");
+    }
+    if(m_eacTexture && (eacTextureSize != eacPageBytes() * m_pageNum || m_atlasFormat != AtlasFormat::Coverage8))
+    {
+        fileFormatError(textureFontFileName, "has an EAC texture that doesn't match the atlas");
+    }
+
+    //the tables are small next to the texture, checking every index keeps the lookups in bounds;
+    //the variants of every slot have to follow it
+    bool valid = m_subpixelPositions >= 1 && m_subpixelPositions <= MAX_SUBPIXEL_POSITIONS && m_characterInfoNum % m_subpixelPositions == 0
+                 && m_characterInfoInvalidIndex < m_characterInfoNum && m_characterInfoInvalidIndex % m_subpixelPositions == 0;
+    for(unsigned int i = 0; valid && i < (UNICODE_CODE_POINT_NUM >> CHARACTER_BLOCK_BITS); i++)
+    {
+        valid = m_characterBlockIndex[i] < m_characterBlockNum;
+    }
+    for(size_t i = 0; valid && i < m_characterBlockNum * CHARACTER_BLOCK_SIZE; i++)
+    {
+        valid = m_characterBlocks[i] < m_characterInfoNum && m_characterBlocks[i] % m_subpixelPositions == 0;
+    }
+    for(size_t i = 0; valid && i < m_characterInfoNum; i++)
+    {
+        const CharacterInfo& info = m_characterInfo[i];
+        valid = info.page < m_pageNum && info.x <= m_textureWidth && info.width <= m_textureWidth - info.x
+                && info.y <= m_textureHeight && info.height <= m_textureHeight - info.y
+                && (m_atlasFormat != AtlasFormat::Coverage4 || info.x % 2 == 0);
+    }
+    for(size_t i = 0; valid && i < m_kerningPairNum; i++)
+    {
+        valid = m_kerningPairs[i].left < m_characterInfoNum && m_kerningPairs[i].right < m_characterInfoNum
+                && m_kerningPairs[i].left % m_subpixelPositions == 0 && m_kerningPairs[i].right % m_subpixelPositions == 0
+                && (i == 0 || kerningPairLess(m_kerningPairs[i - 1], m_kerningPairs[i]));
+    }
+    if(!valid)
+    {
+        fileFormatError(textureFontFileName, "has a character table that points outside of the texture");
+    }
+    for(size_t i = 0; i < characterRangeNum; i++)
+    {
+        m_characterSet.addRange(characterRanges[i].first, characterRanges[i].last);
+    }
+    buildKerningHash();
+    updateGlyphLayout();
+}
+
+TextureFont::~TextureFont()
+{
+    closeFaces(m_faces);
+    if(m_library)
+    {
+        CHECK_FREETYPE_ERROR(FT_Done_FreeType(m_library));
+        m_library = nullptr;
+    }
+    if(m_mapping)
+    {
+        munmap(m_mapping, m_mappingSize);
+        m_mapping = nullptr;
+    }
+}
+
+unsigned int TextureFont::pt() const
+{
+    return m_pt;
+}
+
+bool TextureFont::signedDistanceField() const
+{
+    return m_distanceFieldSpread != 0;
+}
+
+unsigned int TextureFont::distanceFieldSpread() const
+{
+    return m_distanceFieldSpread;
+}
+
+unsigned int TextureFont::characterTotalNum() const
+{
+    return m_characterTotalNum;
+}
+
+const CharacterSet& TextureFont::characterSet() const
+{
+    return m_characterSet;
+}
+
+unsigned int TextureFont::subpixelPositions() const
+{
+    return m_subpixelPositions;
+}
+
+AtlasFormat TextureFont::atlasFormat() const
+{
+    return m_atlasFormat;
+}
+
+unsigned int TextureFont::textureWidth() const
+{
+    return m_textureWidth;
+}
+
+unsigned int TextureFont::textureHeight() const
+{
+    return m_textureHeight;
+}
+
+size_t TextureFont::textureRowBytes() const
+{
+    return atlasRowBytes(m_atlasFormat, m_textureWidth);
+}
+
+unsigned int TextureFont::pageNum() const
+{
+    return m_pageNum;
+}
+
+FontMetrics TextureFont::fontMetrics() const
+{
+    return m_fontMetrics;
+}
+
+CharacterInfo TextureFont::characterInfo(unsigned int unicode, unsigned int phase) const
+{
+    //resolving may grow the tables of a dynamic atlas, so m_characterInfo is read afterwards
+    unsigned int index = resolveCharacter(unicode);
+    return m_characterInfo[index + phase % m_subpixelPositions];
+}
+
+float TextureFont::subpixelPen(float x, unsigned int& phase) const
+{
+    float steps = std::floor(x * m_subpixelPositions + 0.5f);
+    float pixel = std::floor(steps / m_subpixelPositions);
+    phase = (unsigned int)(steps - pixel * m_subpixelPositions);
+    return pixel;
+}
+
+unsigned int TextureFont::resolveCharacter(unsigned int unicode) const
+{
+    if(unicode >= UNICODE_CODE_POINT_NUM)
+    {
+        return m_characterInfoInvalidIndex;
+    }
+    unsigned int index = characterIndex(unicode);
+    if(m_glyphCache)
+    {
+        if(index == UNRESOLVED_CHARACTER)
+        {
+            m_glyphCache->stats.misses++;
+            index = loadCharacter(unicode);
+        }
+        else
+        {
+            m_glyphCache->stats.hits++;
+            auto position = m_glyphCache->lruPosition[index];
+            if(position != m_glyphCache->lru.end())
+            {
+                m_glyphCache->lru.splice(m_glyphCache->lru.begin(), m_glyphCache->lru, position);
+            }
+        }
+    }
+    return index;
+}
+
+unsigned int TextureFont::characterSlot(unsigned int unicode) const
+{
+    return resolveCharacter(unicode);
+}
+
+CharacterInfo TextureFont::slotCharacterInfo(unsigned int slot, unsigned int phase) const
+{
+    return m_characterInfo[slot + phase % m_subpixelPositions];
+}
+
+float TextureFont::kerning(unsigned int left, unsigned int right) const
+{
+    unsigned int leftSlot = resolveCharacter(left);
+    unsigned int rightSlot = resolveCharacter(right);
+    return slotKerning(leftSlot, rightSlot) / 64.0f;
+}
+
+TextureCoord TextureFont::textureCoord(unsigned int unicode, unsigned int phase) const
+{
+    CharacterInfo info = characterInfo(unicode, phase);
+    TextureCoord coord;
+    coord.left = (float)info.x/(float)(m_textureWidth-1);
+    coord.right = (float)(info.x+info.width-1)/(float)(m_textureWidth-1);
+    coord.top = (float)info.y/(float)(m_textureHeight-1);
+    coord.bottom = (float)(info.y+info.height-1)/(float)(m_textureHeight-1);
+    coord.page = info.page;
+    return coord;
+}
+
+size_t TextureFont::layoutText(const char32_t* text, size_t length, float x, float y, float z, float scale,
+                               TextVertex* vertices, float* endX) const
+{
+    unsigned int previousSlot = NO_SLOT;
+    size_t glyphNum = 0;
+    for(size_t first = 0; first < length; first += LAYOUT_CHUNK_SIZE)
+    {
+        size_t num = std::min(length - first, (size_t)LAYOUT_CHUNK_SIZE);
+        glyphNum += layoutChunk(text + first, num, previousSlot, x, y, z, scale, vertices + glyphNum * 4);
+    }
+    if(endX)
+    {
+        *endX = x;
+    }
+    return glyphNum;
+}
+
+size_t TextureFont::layoutText(const char16_t* text, size_t length, float x, float y, float z, float scale,
+                               TextVertex* vertices, float* endX) const
+{
+    char32_t characters[LAYOUT_CHUNK_SIZE];
+    unsigned int previousSlot = NO_SLOT;
+    size_t glyphNum = 0;
+    size_t i = 0;
+    while(i < length)
+    {
+        size_t num = 0;
+        for(; i < length && num < LAYOUT_CHUNK_SIZE; num++)
+        {
+            char32_t character = text[i++];
+            if(character >= 0xd800 && character < 0xdc00 && i < length && text[i] >= 0xdc00 && text[i] < 0xe000)
+            {
+                character = 0x10000 + ((character - 0xd800) << 10) + (text[i++] - 0xdc00);
+            }
+            else if(character >= 0xd800 && character < 0xe000)
+            {
+                character = UNICODE_CODE_POINT_NUM;
+            }
+            characters[num] = character;
+        }
+        glyphNum += layoutChunk(characters, num, previousSlot, x, y, z, scale, vertices + glyphNum * 4);
+    }
+    if(endX)
+    {
+        *endX = x;
+    }
+    return glyphNum;
+}
+
+//the lookups stay scalar, the pen positions and the quads are computed by the SIMD kernels out of
+//the structure of arrays glyph table; length is 1..LAYOUT_CHUNK_SIZE, previousSlot carries the
+//kerning over from the previous chunk
+size_t TextureFont::layoutChunk(const char32_t* text, size_t length, unsigned int& previousSlot, float& x, float y, float z, float scale,
+                                TextVertex* vertices) const
+{
+    unsigned int slots[LAYOUT_CHUNK_SIZE];
+    float advances[LAYOUT_CHUNK_SIZE];
+    float penX[LAYOUT_CHUNK_SIZE];
+    if(m_glyphCache)
+    {
+        for(size_t i = 0; i < length; i++)
+        {
+            slots[i] = resolveCharacter(text[i]);
+        }
+    }
+    else
+    {
+        //without a glyph cache there is no bookkeeping, the map is read directly
+        for(size_t i = 0; i < length; i++)
+        {
+            unsigned int unicode = text[i];
+            slots[i] = unicode < UNICODE_CODE_POINT_NUM ? characterIndex(unicode) : m_characterInfoInvalidIndex;
+        }
+    }
+    for(size_t i = 0; i < length; i++)
+    {
+        advances[i] = m_glyphLayout.advance[slots[i]];
+    }
+    if(m_kerningPairNum != 0)
+    {
+        //the kerning of a pair moves the right glyph, so it is added to the advance of the left one
+        if(previousSlot != NO_SLOT)
+        {
+            x += slotKerning(previousSlot, slots[0]) / 64.0f * scale;
+        }
+        for(size_t i = 0; i + 1 < length; i++)
+        {
+            advances[i] += slotKerning(slots[i], slots[i + 1]) / 64.0f;
+        }
+    }
+    previousSlot = slots[length - 1];
+    x = layoutPenPositions(advances, length, x, scale, penX);
+    if(m_subpixelPositions > 1)
+    {
+        //the variant nearest to the pen is drawn from the pixel instead
+        for(size_t i = 0; i < length; i++)
+        {
+            unsigned int phase;
+            penX[i] = subpixelPen(penX[i] / scale, phase) * scale;
+            slots[i] += phase;
+        }
+    }
+
+    size_t drawn = 0;
+    for(size_t i = 0; i < length; i++)
+    {
+        if(m_glyphLayout.width[slots[i]] != 0.0f && m_glyphLayout.height[slots[i]] != 0.0f)
+        {
+            slots[drawn] = slots[i];
+            penX[drawn] = penX[i];
+            drawn++;
+        }
+    }
+    layoutQuads(m_glyphLayout, slots, penX, drawn, y, z, scale, vertices);
+    return drawn;
+}
+
+int TextureFont::slotKerning(unsigned int left, unsigned int right) const
+{
+    if(m_glyphCache)
+    {
+        left = m_glyphCache->slotGlyphIndex[left];
+        right = m_glyphCache->slotGlyphIndex[right];
+    }
+    //most pairs aren't kerned, the filter fits into the L1 cache and rejects all but a few percent of them
+    uint64_t hash = kerningHash(left, right);
+    size_t filterBit = hash >> (64 - KERNING_FILTER_BITS - m_kerningHashBits);
+    if(!(m_kerningFilter[filterBit / 64] >> (filterBit % 64) & 1))
+    {
+        return 0;
+    }
+    size_t mask = m_kerningHash.size() - 1;
+    for(size_t i = hash >> (64 - m_kerningHashBits); ; i = (i + 1) & mask)
+    {
+        const KerningPair& entry = m_kerningHash[i];
+        if(entry.left == left && entry.right == right)
+        {
+            return entry.value;
+        }
+        if(entry.left == NO_SLOT)
+        {
+            return 0;
+        }
+    }
+}
+
+void TextureFont::buildKerningHash()
+{
+    //at most half full, pairs that get past the filter are mostly found at the first entry
+    m_kerningHashBits = 3;
+    while(((size_t)1 << m_kerningHashBits) < m_kerningPairNum * 2)
+    {
+        m_kerningHashBits++;
+    }
+    m_kerningHash.assign((size_t)1 << m_kerningHashBits, KerningPair{NO_SLOT, NO_SLOT, 0});
+    m_kerningFilter.assign(((size_t)1 << (m_kerningHashBits + KERNING_FILTER_BITS)) / 64, 0);
+    size_t mask = m_kerningHash.size() - 1;
+    for(size_t i = 0; i < m_kerningPairNum; i++)
+    {
+        const KerningPair& pair = m_kerningPairs[i];
+        uint64_t hash = kerningHash(pair.left, pair.right);
+        size_t filterBit = hash >> (64 - KERNING_FILTER_BITS - m_kerningHashBits);
+        m_kerningFilter[filterBit / 64] |= (uint64_t)1 << (filterBit % 64);
+        size_t j = hash >> (64 - m_kerningHashBits);
+        while(m_kerningHash[j].left != NO_SLOT)
+        {
+            j = (j + 1) & mask;
+        }
+        m_kerningHash[j] = pair;
+    }
+}
+
+void TextureFont::saveToTextureFile(const char* textureFontFileName, bool compressTexture) const
+{
+    if(!buildFinished())
+    {
+        std::cerr << "[Error] " << __FILE__ << ": Line" << __LINE__ << " the background build isn't finished, call waitForBuild() first" << std::endl;
+        exit(1);
+    }
+    FileHeader header;
+    header.textureWidth = m_textureWidth;
+    header.textureHeight = m_textureHeight;
+    header.pageNum = m_pageNum;
+    header.characterTotalNum = m_characterTotalNum;
+    header.characterInfoInvalidIndex = m_characterInfoInvalidIndex;
+    header.pt = m_pt;
+    header.distanceFieldSpread = m_distanceFieldSpread;
+    header.ascender = m_fontMetrics.ascender * 64.0f;
+    header.descender = m_fontMetrics.descender * 64.0f;
+    header.lineGap = m_fontMetrics.lineGap * 64.0f;
+
+    std::vector<unsigned int> blocks;
+    const unsigned int* characterBlocks = m_characterBlocks;
+    if(m_glyphCache)
+    {
+        //characters that were never looked up are saved as invalid
+        blocks.assign(m_characterBlocks, m_characterBlocks + m_characterBlockNum * CHARACTER_BLOCK_SIZE);
+        std::replace(blocks.begin(), blocks.end(), UNRESOLVED_CHARACTER, m_characterInfoInvalidIndex);
+        characterBlocks = blocks.data();
+    }
+    std::vector<KerningPair> slotKerningPairs;
+    const KerningPair* kerningPairs = m_kerningPairs;
+    size_t kerningPairNum = m_kerningPairNum;
+    if(m_glyphCache)
+    {
+        //the pairs of a dynamic atlas are keyed by glyph index, only those of resident glyphs are saved
+        for(size_t i = 0; i < m_kerningPairNum; i++)
+        {
+            auto left = m_glyphCache->glyphIndexMap.find(m_kerningPairs[i].left);
+            auto right = m_glyphCache->glyphIndexMap.find(m_kerningPairs[i].right);
+            if(left != m_glyphCache->glyphIndexMap.end() && right != m_glyphCache->glyphIndexMap.end())
+            {
+                slotKerningPairs.push_back(KerningPair{left->second, right->second, m_kerningPairs[i].value});
+            }
+        }
+        std::sort(slotKerningPairs.begin(), slotKerningPairs.end(), kerningPairLess);
+        kerningPairs = slotKerningPairs.data();
+        kerningPairNum = slotKerningPairs.size();
+    }
+
+    std::vector<FileSectionData> sections;
+    std::vector<unsigned char> compressedTexture;
+    if(compressTexture)
+    {
+        compressedTexture = encodeCompressedTexture(texture(), textureRowBytes(), m_textureHeight, m_pageNum);
+        sections.push_back({SECTION_COMPRESSED_TEXTURE, compressedTexture.data(), compressedTexture.size(), SECTION_ALIGNMENT});
+    }
+    else
+    {
+        sections.push_back({SECTION_TEXTURE, texture(), textureRowBytes() * m_textureHeight * m_pageNum, TEXTURE_SECTION_ALIGNMENT});
+    }
+    sections.push_back({SECTION_CHARACTER_INFO, m_characterInfo, m_characterInfoNum * sizeof(CharacterInfo), SECTION_ALIGNMENT});
+    sections.push_back({SECTION_BLOCK_INDEX, m_characterBlockIndex, (UNICODE_CODE_POINT_NUM >> CHARACTER_BLOCK_BITS) * sizeof(unsigned int), SECTION_ALIGNMENT});
+    sections.push_back({SECTION_BLOCKS, characterBlocks, m_characterBlockNum * CHARACTER_BLOCK_SIZE * sizeof(unsigned int), SECTION_ALIGNMENT});
+    sections.push_back({SECTION_KERNING_PAIRS, kerningPairs, kerningPairNum * sizeof(KerningPair), SECTION_ALIGNMENT});
+    if(!m_characterSet.empty())
+    {
+        sections.push_back({SECTION_CHARACTER_SET, m_characterSet.ranges().data(), m_characterSet.ranges().size() * sizeof(CharacterRange), SECTION_ALIGNMENT});
+    }
+    uint32_t subpixelPositions = m_subpixelPositions;
+    if(subpixelPositions > 1)
+    {
+        sections.push_back({SECTION_SUBPIXEL_POSITIONS, &subpixelPositions, sizeof(subpixelPositions), SECTION_ALIGNMENT});
+    }
+    uint32_t atlasFormat = (uint32_t)m_atlasFormat;
+    if(m_atlasFormat != AtlasFormat::Coverage8)
+    {
+        sections.push_back({SECTION_ATLAS_FORMAT, &atlasFormat, sizeof(atlasFormat), SECTION_ALIGNMENT});
+    }
+    if(m_eacTexture)
+    {
+        sections.push_back({SECTION_EAC_TEXTURE, m_eacTexture, eacPageBytes() * m_pageNum, TEXTURE_SECTION_ALIGNMENT});
+    }
+    writeTextureFontFile(textureFontFileName, header, sections);
+}
+
+float TextureFont::occupancy() const
+{
+    unsigned long long usedPixels = 0;
+    for(size_t i = 0; i < m_characterInfoNum; i++)
+    {
+        usedPixels += (unsigned long long)m_characterInfo[i].width * m_characterInfo[i].height;
+    }
+    if(m_textureWidth == 0 || m_textureHeight == 0)
+    {
+        return 0.0f;
+    }
+    return (float)(100.0 * usedPixels / ((double)m_textureWidth * m_textureHeight * m_pageNum));
+}
+
+std::vector<PackingReport> TextureFont::comparePackingStrategies() const
+{
+    if(!buildFinished())
+    {
+        std::cerr << "[Error] " << __FILE__ << ": Line" << __LINE__ << " the background build isn't finished, call waitForBuild() first" << std::endl;
+        exit(1);
+    }
+    const PackingStrategy strategies[] = {PackingStrategy::Shelf, PackingStrategy::Skyline, PackingStrategy::MaxRects};
+    std::vector<PackingReport> reports;
+    std::vector<PackRect> rects(m_characterInfoNum / m_subpixelPositions);
+    for(size_t i = 0; i < rects.size(); i++)
+    {
+        rects[i] = variantRect(m_characterInfo + i * m_subpixelPositions, m_subpixelPositions, m_atlasFormat);
+    }
+    for(auto strategy : strategies)
+    {
+        reports.push_back(packRects(rects, strategy, false, m_textureWidth, m_pageNum > 1 ? m_textureHeight : 0));
+        reports.push_back(packRects(rects, strategy, true, m_textureWidth, m_pageNum > 1 ? m_textureHeight : 0));
+    }
+    return reports;
+}
+
+const unsigned char* TextureFont::texture() const
+{
+    if(!m_texture)
+    {
+        m_textureStorage.resize(textureRowBytes() * m_textureHeight * m_pageNum);
+        decodeTexture(m_textureStorage.data());
+        m_texture = m_textureStorage.data();
+    }
+    return m_texture;
+}
+
+const unsigned char* TextureFont::texture(unsigned int page) const
+{
+    return texture() + (size_t)page * textureRowBytes() * m_textureHeight;
+}
+
+void TextureFont::copyTexture(unsigned char* destination) const
+{
+    if(m_texture)
+    {
+        memcpy(destination, m_texture, textureRowBytes() * m_textureHeight * m_pageNum);
+    }
+    else
+    {
+        decodeTexture(destination);
+    }
+}
+
+void TextureFont::decodeTexture(unsigned char* destination) const
+{
+    if(!decodeCompressedTexture(m_compressedTexture, m_compressedTextureSize, destination, textureRowBytes(), m_textureHeight, m_pageNum))
+    {
+        std::cerr << "[Error] " << __FILE__ << ": Line" << __LINE__ << " the compressed texture is damaged" << std::endl;
+        exit(1);
+    }
+}
+
+const unsigned char* TextureFont::eacTexture() const
+{
+    return m_eacTexture;
+}
+
+const unsigned char* TextureFont::eacTexture(unsigned int page) const
+{
+    return m_eacTexture ? m_eacTexture + eacPageBytes() * page : nullptr;
+}
+
+size_t TextureFont::eacPageBytes() const
+{
+    return eacImageBytes(m_textureWidth, m_textureHeight);
+}
+
+std::vector<GlyphCompressionError> TextureFont::eacErrors() const
+{
+    std::vector<GlyphCompressionError> errors;
+    if(!m_eacTexture)
+    {
+        return errors;
+    }
+    //downwards, so the lowest code point of a slot is the one left
+    std::vector<unsigned int> unicodes(m_characterInfoNum, UNRESOLVED_CHARACTER);
+    for(unsigned int unicode = UNICODE_CODE_POINT_NUM; unicode-- > 0;)
+    {
+        unicodes[characterIndex(unicode)] = unicode;
+    }
+    std::vector<unsigned char> decoded((size_t)m_textureWidth * m_textureHeight);
+    for(unsigned int page = 0; page < m_pageNum; page++)
+    {
+        decodeEacR11(eacTexture(page), m_textureWidth, m_textureHeight, decoded.data(), m_textureWidth);
+        const unsigned char* original = texture(page);
+        for(size_t slot = 0; slot < m_characterInfoNum; slot++)
+        {
+            const CharacterInfo& info = m_characterInfo[slot];
+            unsigned int base = slot - slot % m_subpixelPositions;
+            if(info.page != page || info.width == 0 || info.height == 0 || unicodes[base] == UNRESOLVED_CHARACTER)
+            {
+                continue;
+            }
+            GlyphCompressionError error{unicodes[base], (unsigned int)(slot - base), 0, 0.0f};
+            double squaredError = 0.0;
+            for(unsigned int y = info.y; y < info.y + info.height; y++)
+            {
+                for(unsigned int x = info.x; x < info.x + info.width; x++)
+                {
+                    size_t i = (size_t)y * m_textureWidth + x;
+                    unsigned int difference = std::abs(decoded[i] - original[i]);
+                    error.maxError = std::max(error.maxError, difference);
+                    squaredError += difference * difference;
+                }
+            }
+            error.rmsError = std::sqrt(squaredError / ((double)info.width * info.height));
+            errors.push_back(error);
+        }
+    }
+    std::sort(errors.begin(), errors.end(), [](const GlyphCompressionError& a, const GlyphCompressionError& b) {
+        return a.rmsError > b.rmsError;
+    });
+    return errors;
+}
+
+CharacterImage TextureFont::characterImage(unsigned int unicode) const
+{
+    CharacterImageView view = characterImageView(unicode);
+    CharacterImage chimage;
+    chimage.m_width = view.width;
+    chimage.m_height = view.height;
+    chimage.m_bitmap_left = view.bitmap_left;
+    chimage.m_bitmap_top = view.bitmap_top;
+    chimage.m_format = view.format;
+    size_t rowBytes = atlasRowBytes(view.format, view.width);
+    chimage.m_image = new unsigned char[rowBytes * view.height];
+    for(unsigned int i = 0; i < view.height; i++)
+    {
+        memcpy(chimage.m_image + i * rowBytes, view.pixels + (size_t)i * view.stride, rowBytes);
+    }
+    return chimage;
+}
+
+CharacterImageView TextureFont::characterImageView(unsigned int unicode, unsigned int phase) const
+{
+    CharacterInfo chinfo = characterInfo(unicode, phase);
+    CharacterImageView view;
+    view.pixels = texture(chinfo.page) + (size_t)chinfo.y * textureRowBytes() + atlasRowBytes(m_atlasFormat, chinfo.x);
+    view.width = chinfo.width;
+    view.height = chinfo.height;
+    view.stride = textureRowBytes();
+    view.bitmap_left = chinfo.bitmap_left;
+    view.bitmap_top = chinfo.bitmap_top;
+    view.format = m_atlasFormat;
+    return view;
+}
+
+CharacterImageView TextureFont::characterImage(unsigned int unicode, CharacterImageArena& arena) const
+{
+    return arena.copy(characterImageView(unicode));
+}
+
+unsigned int TextureFont::characterIndex(unsigned int unicode) const
+{
+    return m_characterBlocks[(m_characterBlockIndex[unicode >> CHARACTER_BLOCK_BITS] << CHARACTER_BLOCK_BITS) | (unicode & (CHARACTER_BLOCK_SIZE - 1))];
+}
+
+void TextureFont::setCharacterIndex(unsigned int unicode, unsigned int index) const
+{
+    unsigned int& block = m_characterBlockIndexStorage[unicode >> CHARACTER_BLOCK_BITS];
+    if(block == 0)
+    {
+        //copy on write of the shared block
+        size_t offset = m_characterBlocksStorage.size();
+        block = offset / CHARACTER_BLOCK_SIZE;
+        m_characterBlocksStorage.resize(offset + CHARACTER_BLOCK_SIZE);
+        std::copy(m_characterBlocksStorage.begin(), m_characterBlocksStorage.begin() + CHARACTER_BLOCK_SIZE, m_characterBlocksStorage.begin() + offset);
+        updateViews();
+    }
+    m_characterBlocksStorage[(block << CHARACTER_BLOCK_BITS) | (unicode & (CHARACTER_BLOCK_SIZE - 1))] = index;
+}
+
+std::vector<DirtyRect> TextureFont::takeDirtyRects()
+{
+    std::vector<DirtyRect> dirtyRects;
+    if(m_glyphCache)
+    {
+        dirtyRects.swap(m_glyphCache->dirtyRects);
+    }
+    if(m_backgroundBuild)
+    {
+        publishGlyphs();
+        dirtyRects.swap(m_backgroundBuild->dirtyRects);
+        if(buildFinished())
+        {
+            //the last regions are handed out, the workers and staging bitmaps can go
+            m_backgroundBuild.reset();
+        }
+    }
+    return dirtyRects;
+}
+
+std::vector<unsigned int> TextureFont::takeEvictedCharacters()
+{
+    std::vector<unsigned int> evictedCharacters;
+    if(m_glyphCache)
+    {
+        evictedCharacters.swap(m_glyphCache->evictedCharacters);
+    }
+    return evictedCharacters;
+}
+
+GlyphCacheStats TextureFont::glyphCacheStats() const
+{
+    if(m_glyphCache)
+    {
+        return m_glyphCache->stats;
+    }
+    return GlyphCacheStats{0, 0, 0};
+}
+
+unsigned long long TextureFont::atlasGeneration() const
+{
+    return m_atlasGeneration;
+}
+
+size_t TextureFont::publishGlyphs()
+{
+    if(!m_backgroundBuild)
+    {
+        return 0;
+    }
+    BackgroundBuild& build = *m_backgroundBuild;
+    size_t glyphNum = 0;
+    while(build.publishedChunkNum < build.chunkNum && build.chunkDone[build.publishedChunkNum].load(std::memory_order_acquire))
+    {
+        size_t begin = 1 + build.publishedChunkNum * BUILD_CHUNK_SIZE;
+        size_t end = std::min(begin + BUILD_CHUNK_SIZE, build.glyphKeys.size());
+        for(size_t i = begin; i < end; i++)
+        {
+            size_t slot = i * m_subpixelPositions;
+            placeBuiltGlyph(slot, &build.glyphs[slot]);
+            for(unsigned int phase = 0; phase < m_subpixelPositions; phase++)
+            {
+                std::vector<unsigned char>().swap(build.glyphs[slot + phase].buffer);
+            }
+        }
+        glyphNum += end - begin;
+        build.publishedChunkNum++;
+    }
+    if(glyphNum != 0)
+    {
+        m_atlasGeneration++;
+    }
+    if(build.publishedChunkNum == build.chunkNum)
+    {
+        build.joinWorkers();
+    }
+    return glyphNum;
+}
+
+void TextureFont::waitForBuild()
+{
+    if(m_backgroundBuild)
+    {
+        m_backgroundBuild->joinWorkers();
+        publishGlyphs();
+    }
+}
+
+bool TextureFont::buildFinished() const
+{
+    return !m_backgroundBuild || m_backgroundBuild->publishedChunkNum == m_backgroundBuild->chunkNum;
+}
+
+float TextureFont::buildProgress() const
+{
+    if(!m_backgroundBuild)
+    {
+        return 100.0f;
+    }
+    //the invalid glyph is rendered by the constructor
+    size_t renderedGlyphNum = 1 + m_backgroundBuild->renderedGlyphNum.load(std::memory_order_relaxed);
+    return 100.0f * renderedGlyphNum / m_backgroundBuild->glyphKeys.size();
+}
+
+unsigned int TextureFont::loadCharacter(unsigned int unicode) const
+{
+    GlyphCache& cache = *m_glyphCache;
+    //the first face of the chain that has the code point, the invalid glyph if none has
+    FT_UInt glyph = 0;
+    for(size_t i = 0; i < m_faces.size() && (m_characterSet.empty() || m_characterSet.contains(unicode)); i++)
+    {
+        FT_UInt glyph_index = FT_Get_Char_Index(m_faces[i], unicode);
+        if(glyph_index != 0)
+        {
+            glyph = glyphKey(i, glyph_index);
+            break;
+        }
+    }
+    unsigned int index;
+    auto iter = cache.glyphIndexMap.find(glyph);
+    if(iter != cache.glyphIndexMap.end())
+    {
+        index = iter->second;
+    }
+    else
+    {
+        std::vector<GlyphBitmap> variants(m_subpixelPositions);
+        renderGlyphVariants(m_faces, glyph, m_subpixelPositions, m_distanceFieldSpread, m_freetypeDistanceField, m_atlasFormat, variants.data());
+        index = insertGlyph(glyph, variants.data(), false);
+    }
+    if(index != m_characterInfoInvalidIndex)
+    {
+        cache.slotCharacters[index].push_back(unicode);
+    }
+    setCharacterIndex(unicode, index);
+    return index;
+}
+
+//the variants of a glyph take one rect and as many consecutive slots, the per slot state of the cache
+//belongs to the first one
+unsigned int TextureFont::insertGlyph(FT_UInt glyph, const GlyphBitmap* variants, bool pinned) const
+{
+    GlyphCache& cache = *m_glyphCache;
+    PackRect rect = variantRect(variants, m_subpixelPositions, m_atlasFormat);
+    if(rect.width > m_textureWidth || rect.height > m_textureHeight)
+    {
+        std::cerr << "[Error] " << __FILE__ << ": Line " << __LINE__ << " a " << rect.width << "x" << rect.height << " glyph is larger than the " << m_textureWidth << "x" << m_textureHeight << " atlas page" << std::endl;
+        exit(1);
+    }
+
+    unsigned int slot = NO_SLOT;
+    if(!allocateRect(rect))
+    {
+        //the page budget is used up: reuse the space of the least recently used glyph that is
+        //large enough, and start over with empty pages if fragmentation leaves none
+        slot = evictSlotFor(rect);
+        if(slot == NO_SLOT)
+        {
+            flushGlyphCache();
+            allocateRect(rect);
+        }
+    }
+    if(slot == NO_SLOT)
+    {
+        if(cache.freeSlots.empty())
+        {
+            slot = m_characterInfoStorage.size();
+            m_characterInfoStorage.resize(slot + m_subpixelPositions, variants[0].info);
+            cache.slotRects.resize(slot + m_subpixelPositions, rect);
+            cache.slotGlyphIndex.resize(slot + m_subpixelPositions, 0);
+            cache.slotCharacters.resize(slot + m_subpixelPositions);
+            cache.lruPosition.resize(slot + m_subpixelPositions, cache.lru.end());
+        }
+        else
+        {
+            slot = cache.freeSlots.back();
+            cache.freeSlots.pop_back();
+            cache.slotRects[slot] = rect;
+        }
+    }
+
+    updateViews();
+    placeVariants(slot, rect, variants);
+    cache.glyphIndexMap[glyph] = slot;
+    cache.slotGlyphIndex[slot] = glyph;
+    if(!pinned)
+    {
+        cache.lru.push_front(slot);
+        cache.lruPosition[slot] = cache.lru.begin();
+    }
+    cache.markDirty(rect.page, rect.x, rect.y, rect.width, rect.height);
+    return slot;
+}
+
+bool TextureFont::allocateRect(PackRect& rect) const
+{
+    GlyphCache& cache = *m_glyphCache;
+    if(!cache.packer->insert(rect.width, rect.height, rect.x, rect.y))
+    {
+        if(cache.packerPage + 1 < m_pageNum)
+        {
+            cache.packerPage++;
+            cache.packer = AtlasPacker::create(cache.packingStrategy, m_textureWidth, m_textureHeight);
+        }
+        else if(cache.maxPageNum == 0 || m_pageNum < cache.maxPageNum)
+        {
+            addPage();
+        }
+        else
+        {
+            return false;
+        }
+        cache.packer->insert(rect.width, rect.height, rect.x, rect.y);
+    }
+    rect.page = cache.packerPage;
+    return true;
+}
+
+unsigned int TextureFont::evictSlotFor(PackRect& rect) const
+{
+    GlyphCache& cache = *m_glyphCache;
+    for(auto iter = cache.lru.rbegin(); iter != cache.lru.rend(); iter++)
+    {
+        const PackRect& slotRect = cache.slotRects[*iter];
+        if(rect.width <= slotRect.width && rect.height <= slotRect.height)
+        {
+            unsigned int slot = *iter;
+            evictSlot(slot);
+            rect.x = slotRect.x;
+            rect.y = slotRect.y;
+            rect.page = slotRect.page;
+            return slot;
+        }
+    }
+    return NO_SLOT;
+}
+
+void TextureFont::evictSlot(unsigned int slot) const
+{
+    GlyphCache& cache = *m_glyphCache;
+    for(auto iter = cache.slotCharacters[slot].begin(); iter != cache.slotCharacters[slot].end(); iter++)
+    {
+        setCharacterIndex(*iter, UNRESOLVED_CHARACTER);
+        cache.evictedCharacters.push_back(*iter);
+    }
+    cache.slotCharacters[slot].clear();
+    cache.glyphIndexMap.erase(cache.slotGlyphIndex[slot]);
+    cache.lru.erase(cache.lruPosition[slot]);
+    cache.lruPosition[slot] = cache.lru.end();
+    cache.stats.evictions++;
+    m_atlasGeneration++;
+
+    const PackRect& rect = cache.slotRects[slot];
+    unsigned char* page = m_textureStorage.data() + (size_t)rect.page * textureRowBytes() * m_textureHeight;
+    for(unsigned int j = 0; j < rect.height; j++)
+    {
+        memset(page + (rect.y + j) * textureRowBytes() + atlasRowBytes(m_atlasFormat, rect.x), 0, atlasRowBytes(m_atlasFormat, rect.width));
+    }
+    cache.markDirty(rect.page, rect.x, rect.y, rect.width, rect.height);
+}
+
+void TextureFont::flushGlyphCache() const
+{
+    GlyphCache& cache = *m_glyphCache;
+    while(!cache.lru.empty())
+    {
+        unsigned int slot = cache.lru.back();
+        evictSlot(slot);
+        cache.freeSlots.push_back(slot);
+    }
+    //the pinned invalid glyph was the first one packed into page 0, packing it into a fresh
+    //packer again puts it back where its pixels still are
+    cache.packerPage = 0;
+    cache.packer = AtlasPacker::create(cache.packingStrategy, m_textureWidth, m_textureHeight);
+    PackRect& invalidRect = cache.slotRects[m_characterInfoInvalidIndex];
+    cache.packer->insert(invalidRect.width, invalidRect.height, invalidRect.x, invalidRect.y);
+}
+
+void TextureFont::addPage() const
+{
+    GlyphCache& cache = *m_glyphCache;
+    m_textureStorage.resize(textureRowBytes() * m_textureHeight * (m_pageNum + 1), 0);
+    m_pageNum++;
+    updateViews();
+    cache.packerPage = m_pageNum - 1;
+    cache.packer = AtlasPacker::create(cache.packingStrategy, m_textureWidth, m_textureHeight);
+}
+
+void TextureFont::updateViews() const
+{
+    m_texture = m_textureStorage.data();
+    m_characterInfo = m_characterInfoStorage.data();
+    m_characterInfoNum = m_characterInfoStorage.size();
+    m_characterBlockIndex = m_characterBlockIndexStorage.data();
+    m_characterBlocks = m_characterBlocksStorage.data();
+    m_characterBlockNum = m_characterBlocksStorage.size() / CHARACTER_BLOCK_SIZE;
+}
+
+void TextureFont::startBackgroundBuild(const std::vector<FontFace>& faces, unsigned int h_resolution, unsigned int v_resolution,
+                                       const std::vector<FT_UInt>& glyphs, const TextureFontOptions& options)
+{
+    m_textureWidth = TEXTURE_WIDTH;
+    if(options.maxTextureSize != 0 && options.maxTextureSize < m_textureWidth)
+    {
+        m_textureWidth = options.maxTextureSize;
+    }
+    m_textureHeight = m_textureWidth;
+    m_backgroundBuild.reset(new BackgroundBuild(options.packingStrategy, glyphs, m_subpixelPositions));
+
+    //every slot shows the invalid glyph until its own is published
+    std::vector<GlyphBitmap> invalidGlyph(m_subpixelPositions);
+    renderGlyphVariants(m_faces, 0, m_subpixelPositions, m_distanceFieldSpread, m_freetypeDistanceField, m_atlasFormat, invalidGlyph.data());
+    m_characterInfoStorage.assign(glyphs.size() * m_subpixelPositions, invalidGlyph[0].info);
+    updateViews();
+    updateGlyphLayout();
+    placeBuiltGlyph(m_characterInfoInvalidIndex, invalidGlyph.data());
+    for(size_t i = m_subpixelPositions; i < m_characterInfoStorage.size(); i++)
+    {
+        m_characterInfoStorage[i] = m_characterInfoStorage[m_characterInfoInvalidIndex + i % m_subpixelPositions];
+    }
+    updateGlyphLayout();
+
+    unsigned int threadNum = options.threadNum;
+    if(threadNum == 0)
+    {
+        threadNum = std::max(1u, std::thread::hardware_concurrency());
+    }
+    BackgroundBuild* build = m_backgroundBuild.get();
+    unsigned int pt = m_pt;
+    unsigned int subpixelPositions = m_subpixelPositions;
+    unsigned int distanceFieldSpread = m_distanceFieldSpread;
+    bool freetypeDistanceField = m_freetypeDistanceField;
+    AtlasFormat format = m_atlasFormat;
+    for(unsigned int t = 0; t < threadNum && t < build->chunkNum; t++)
+    {
+        build->workers.emplace_back([=]() {
+            FT_Library library;
+            CHECK_FREETYPE_ERROR(FT_Init_FreeType(&library));
+            setDistanceFieldSpread(library, distanceFieldSpread);
+            setLcdFilter(library, format);
+            std::vector<FT_Face> workerFaces = openFaces(library, faces, pt, h_resolution, v_resolution);
+            while(!build->stop.load(std::memory_order_relaxed))
+            {
+                size_t chunk = build->nextChunk.fetch_add(1);
+                if(chunk >= build->chunkNum)
+                {
+                    break;
+                }
+                size_t begin = 1 + chunk * BUILD_CHUNK_SIZE;
+                size_t end = std::min(begin + BUILD_CHUNK_SIZE, build->glyphKeys.size());
+                for(size_t i = begin; i < end; i++)
+                {
+                    renderGlyphVariants(workerFaces, build->glyphKeys[i], subpixelPositions, distanceFieldSpread, freetypeDistanceField, format,
+                                        &build->glyphs[i * subpixelPositions]);
+                }
+                build->renderedGlyphNum.fetch_add(end - begin, std::memory_order_relaxed);
+                build->chunkDone[chunk].store(true, std::memory_order_release);
+            }
+            closeFaces(workerFaces);
+            CHECK_FREETYPE_ERROR(FT_Done_FreeType(library));
+        });
+    }
+
+    closeFaces(m_faces);
+    CHECK_FREETYPE_ERROR(FT_Done_FreeType(m_library));
+    m_library = nullptr;
+}
+
+void TextureFont::placeBuiltGlyph(unsigned int slot, const GlyphBitmap* variants)
+{
+    BackgroundBuild& build = *m_backgroundBuild;
+    PackRect rect = variantRect(variants, m_subpixelPositions, m_atlasFormat);
+    if(rect.width > m_textureWidth || rect.height > m_textureHeight)
+    {
+        std::cerr << "[Error] " << __FILE__ << ": Line " << __LINE__ << " a " << rect.width << "x" << rect.height << " glyph is larger than the " << m_textureWidth << "x" << m_textureHeight << " atlas page" << std::endl;
+        exit(1);
+    }
+    if(!build.packer || !build.packer->insert(rect.width, rect.height, rect.x, rect.y))
+    {
+        //pages are only appended, the renderer uploads the reallocated texture again
+        m_textureStorage.resize(textureRowBytes() * m_textureHeight * (m_pageNum + 1), 0);
+        m_pageNum++;
+        updateViews();
+        build.packerPage = m_pageNum - 1;
+        build.packer = AtlasPacker::create(build.packingStrategy, m_textureWidth, m_textureHeight);
+        build.packer->insert(rect.width, rect.height, rect.x, rect.y);
+    }
+    rect.page = build.packerPage;
+    placeVariants(slot, rect, variants);
+    mergeDirtyRect(build.dirtyRects, rect.page, rect.x, rect.y, rect.width, rect.height);
+}
+
+//the variants side by side from the left of rect, into the slots from slot on
+void TextureFont::placeVariants(unsigned int slot, const PackRect& rect, const GlyphBitmap* variants) const
+{
+    unsigned int x = rect.x;
+    for(unsigned int phase = 0; phase < m_subpixelPositions; phase++)
+    {
+        CharacterInfo placed = variants[phase].info;
+        placed.x = x + BLANK_COLUMN;
+        placed.y = rect.y;
+        placed.page = rect.page;
+        m_characterInfoStorage[slot + phase] = placed;
+        updateGlyphLayout(slot + phase);
+        x += glyphColumns(placed.width, m_atlasFormat);
+
+        unsigned char* page = m_textureStorage.data() + (size_t)placed.page * textureRowBytes() * m_textureHeight;
+        writeGlyph(page, textureRowBytes(), m_atlasFormat, m_coverageTable, placed, variants[phase].buffer.data());
+    }
+}
+
+void TextureFont::updateGlyphLayout() const
+{
+    m_glyphLayout.resize(m_characterInfoNum);
+    for(size_t i = 0; i < m_characterInfoNum; i++)
+    {
+        updateGlyphLayout(i);
+    }
+}
+
+void TextureFont::updateGlyphLayout(unsigned int slot) const
+{
+    if(slot >= m_glyphLayout.advance.size())
+    {
+        m_glyphLayout.resize(m_characterInfoNum);
+    }
+    const CharacterInfo& info = m_characterInfo[slot];
+    m_glyphLayout.left[slot] = (int)info.bitmap_left;
+    m_glyphLayout.top[slot] = (int)info.bitmap_top;
+    m_glyphLayout.width[slot] = info.width;
+    m_glyphLayout.height[slot] = info.height;
+    m_glyphLayout.advance[slot] = (int)info.advance / 64.0f;
+    m_glyphLayout.u0[slot] = (float)info.x/(float)(m_textureWidth-1);
+    m_glyphLayout.u1[slot] = (float)(info.x+info.width-1)/(float)(m_textureWidth-1);
+    m_glyphLayout.v0[slot] = (float)info.y/(float)(m_textureHeight-1);
+    m_glyphLayout.v1[slot] = (float)(info.y+info.height-1)/(float)(m_textureHeight-1);
+    m_glyphLayout.page[slot] = info.page;
 }
@@ -3,12 +3,18 @@
 
 #include <string>
 #include <vector>
+#include <memory>
+#include <cstdint>
+#include "atlaspacker.h"
+#include "characterset.h"
+#include "textlayout.h"
 #include <ft2build.h>
 #include FT_FREETYPE_H
 #include FT_GLYPH_H
 #include FT_TYPES_H
 #include FT_OUTLINE_H
 #include FT_RENDER_H
+#include FT_MODULE_H
 
 struct CharacterInfo
 {
@@ -18,6 +24,24 @@ struct CharacterInfo
     unsigned int height;
     unsigned int bitmap_left;
     unsigned int bitmap_top;
+    unsigned int page;
+    unsigned int advance;  //of the pen, in 1/64 pixel
+};
+
+//a pair of glyphs whose distance differs from the advance of the left one
+struct KerningPair
+{
+    unsigned int left;   //slot of the left glyph
+    unsigned int right;  //slot of the right glyph
+    int value;  //added to the advance of the left glyph, in 1/64 pixel
+};
+
+struct FontMetrics
+{
+    float ascender;   //in pixel above the baseline
+    float descender;  //in pixel, negative below the baseline
+    float lineGap;    //in pixel between the descender of a line and the ascender of the next
+    float lineHeight;  //baseline to baseline, ascender - descender + lineGap
 };
 
 struct TextureCoord
@@ -26,6 +50,110 @@ struct TextureCoord
     float right;
     float top;
     float bottom;
+    unsigned int page;
+};
+
+struct DirtyRect
+{
+    unsigned int page;
+    unsigned int x;
+    unsigned int y;
+    unsigned int width;
+    unsigned int height;
+};
+
+struct GlyphCacheStats
+{
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+};
+
+//a glyph of the EAC R11 texture decoded and compared with the atlas, in 1/255 of full coverage
+struct GlyphCompressionError
+{
+    unsigned int unicode;  //the lowest code point drawn with the glyph
+    unsigned int phase;    //subpixel variant
+    unsigned int maxError;
+    float rmsError;
+};
+
+//how the atlas stores a pixel
+enum class AtlasFormat
+{
+    Coverage8,  //a byte of coverage
+    Coverage4,  //4 bit coverage, two horizontally adjacent pixels per byte with the left one in the low nibble
+    LCD         //FT_RENDER_MODE_LCD, a byte of coverage for each of the R, G and B subpixels, in this order
+};
+
+const char* atlasFormatName(AtlasFormat format);
+//bytes of a row of width pixels, in the texture and in a CharacterImageView; Coverage4 glyphs start at even columns
+size_t atlasRowBytes(AtlasFormat format, unsigned int width);
+
+//a face of a font file, faceIndex selects one of a collection (.ttc, .otc)
+struct FontFace
+{
+    std::string fileName;
+    unsigned int faceIndex;
+};
+
+struct TextureFontOptions
+{
+    TextureFontOptions();
+
+    unsigned int threadNum;  //rasterizing threads, 0 means std::thread::hardware_concurrency()
+    unsigned int faceIndex;  //of fontFileName, if it is a collection
+    //tried in order for the code points fontFileName lacks, their glyphs are packed into the same atlas.
+    //Line metrics are those of fontFileName, kerning only applies between glyphs of the same face
+    std::vector<FontFace> fallbackFaces;
+    PackingStrategy packingStrategy;
+    bool sortByHeight;  //insert the tallest glyphs first
+    unsigned int maxTextureSize;  //in pixel, glyphs are split into pages no larger than this, 0 means a single page
+    bool dynamicAtlas;  //keep the face open and rasterize every glyph on its first lookup
+    unsigned int dynamicPageSize;  //in pixel, width and height of the pages of a dynamic atlas
+    unsigned int maxPageNum;  //page budget of a dynamic atlas, least recently used glyphs are evicted beyond it, 0 means unbounded
+    //store signed distance fields instead of coverage, so one atlas can be drawn at any scale:
+    //128 is the outline, larger is inside, one step of 128 / distanceFieldSpread per pixel
+    bool signedDistanceField;
+    unsigned int distanceFieldSpread;  //in pixel, 2..32, glyphs grow by this on every side
+    //render the fields from the outlines with FreeType's sdf module (2.11 and later) instead of
+    //transforming the coverage bitmaps; slightly more exact and about 25 times slower
+    bool freetypeDistanceField;
+    //static atlas only: return from the constructor once the code point map is built and rasterize on
+    //threadNum background workers; see publishGlyphs(). Pages are square, maxTextureSize or 4096 pixel,
+    //and glyphs are packed in code point order, so sortByHeight has no effect
+    bool backgroundBuild;
+    //bake only these code points, the invalid glyph is always included; a dynamic atlas resolves every
+    //other code point to the invalid glyph. Empty bakes every code point of the face
+    CharacterSet characterSet;
+    //1..4 rasterizations of every glyph, variant p shifted right by p / subpixelPositions pixel and packed
+    //next to the others. Above 1 the layout draws the variant nearest to the pen and snaps the pen to the
+    //pixel instead of placing glyphs between pixels, so moving text keeps its shape; advances and kerning
+    //are unhinted then and glyphs are hinted vertically only
+    unsigned int subpixelPositions;
+    AtlasFormat atlasFormat;  //distance fields need Coverage8
+    //coverage c is baked as 255 * (c / 255)^(1 / coverageGamma), so the shaders sample it as it is;
+    //above 1 thickens the antialiased edges that blending in a non linear framebuffer thins out.
+    //0.25..4, 1 keeps the coverage linear; distance fields need 1
+    float coverageGamma;
+    //also encode the atlas into EAC R11 blocks on threadNum threads, see eacTexture(); a static
+    //coverage8 atlas built in the constructor only
+    bool eacTexture;
+};
+
+struct GlyphBitmap;  //a rasterized glyph before it is placed into the atlas
+
+//the pixels of a glyph where they are, in the format of the atlas: row i starts at pixels + i * stride
+//and takes atlasRowBytes(format, width) bytes
+struct CharacterImageView
+{
+    const unsigned char* pixels;
+    unsigned int width;   //in pixel
+    unsigned int height;
+    unsigned int stride;  //in byte
+    unsigned int bitmap_left;
+    unsigned int bitmap_top;
+    AtlasFormat format;
 };
 
 class CharacterImage final
@@ -42,34 +170,135 @@ public:
     unsigned int height() const;
     unsigned int bitmap_left() const;
     unsigned int bitmap_top() const;
-    const unsigned char* image() const;
+    AtlasFormat format() const;
+    const unsigned char* image() const;  //rows of atlasRowBytes(format(), width()) bytes
+
+private:
+    size_t byteSize() const;
 
 private:
     unsigned int m_width;
     unsigned int m_height;
     unsigned int m_bitmap_left;
     unsigned int m_bitmap_top;
+    AtlasFormat m_format;
     unsigned char* m_image;
 
     friend class TextureFont;
 };
 
+//bump allocated copies of glyph images; clear() keeps the memory, so a caller that copies the same
+//amount every frame stops allocating after the first one
+class CharacterImageArena final
+{
+public:
+    explicit CharacterImageArena(size_t blockSize = 64 * 1024);
+
+    //a tightly packed copy, stride is the row size; valid until clear() or the arena is destroyed
+    CharacterImageView copy(const CharacterImageView& view);
+    void clear();
+    size_t byteSize() const;  //allocated
+    size_t usedByteSize() const;  //since the last clear()
+
+private:
+    CharacterImageArena& operator=(const CharacterImageArena&) = delete;
+    CharacterImageArena(const CharacterImageArena&) = delete;
+
+    unsigned char* allocate(size_t size);
+
+private:
+    size_t m_blockSize;
+    std::vector<std::unique_ptr<unsigned char[]> > m_blocks;
+    std::vector<size_t> m_blockSizes;
+    size_t m_block;   //being filled
+    size_t m_offset;  //into m_blocks[m_block]
+    size_t m_usedByteSize;
+};
+
 class TextureFont final
 {
 public:
-    TextureFont(const char* fontFileName, unsigned int pt, unsigned int h_resolution, unsigned int v_resolution);
-    TextureFont(const char* textureFontFileName);
+    TextureFont(const char* fontFileName, unsigned int pt, unsigned int h_resolution, unsigned int v_resolution,
+                const TextureFontOptions& options = TextureFontOptions());
+    //maps the file read-only, texture() and the character tables point into the mapping;
+    //verifyPayload additionally checksums the texture and tables instead of only the header
+    TextureFont(const char* textureFontFileName, bool verifyPayload = false);
     ~TextureFont();
 
     unsigned int pt() const;
-    unsigned int characterTotalNum() const;
-    unsigned int textureWidth() const;
-    unsigned int textureHeight() const;
-    CharacterInfo characterInfo(unsigned int unicode) const;
-    TextureCoord textureCoord(unsigned int unicode) const;
-    void saveToTextureFile(const char* textureFontFileName) const;
-    const unsigned char* texture() const;
-    CharacterImage characterImage(unsigned int unicode) const;
+    bool signedDistanceField() const;
+    unsigned int distanceFieldSpread() const;  //0 for coverage
+    unsigned int characterTotalNum() const;  //code points of U+0000..U+10FFFF that have a glyph, within the subset
+    const CharacterSet& characterSet() const;  //the subset the font was baked from, empty for the whole face
+    unsigned int subpixelPositions() const;  //variants per glyph, 1 without subpixel positioning
+    AtlasFormat atlasFormat() const;
+    unsigned int textureWidth() const;   //in pixel
+    unsigned int textureHeight() const;  //of every page
+    size_t textureRowBytes() const;  //atlasRowBytes(atlasFormat(), textureWidth())
+    unsigned int pageNum() const;
+    FontMetrics fontMetrics() const;
+    //phase selects the variant shifted by phase / subpixelPositions() pixel, taken modulo subpixelPositions()
+    CharacterInfo characterInfo(unsigned int unicode, unsigned int phase = 0) const;
+    TextureCoord textureCoord(unsigned int unicode, unsigned int phase = 0) const;
+    //splits a pen position in pixels into the pixel returned and the phase of the variant nearest to it;
+    //with 1 subpixel position the pen is rounded to the pixel
+    float subpixelPen(float x, unsigned int& phase) const;
+    float kerning(unsigned int left, unsigned int right) const;  //between two code points, in pixel
+    //for callers that place the glyphs themselves: a code point is resolved into its slot once, which loads
+    //it into a dynamic atlas and marks it recently used, then the lookups below take the slot. A slot
+    //stays valid until atlasGeneration() changes
+    unsigned int characterSlot(unsigned int unicode) const;
+    CharacterInfo slotCharacterInfo(unsigned int slot, unsigned int phase = 0) const;
+    int slotKerning(unsigned int leftSlot, unsigned int rightSlot) const;  //in 1/64 pixel, like CharacterInfo::advance
+    //lays text out left to right from the pen position (x, y) on the baseline with the advances and
+    //kerning of the font, y grows upwards and scale converts atlas pixels to the units of x and y.
+    //With subpixel variants x / scale is taken as pixels of the target to pick them.
+    //Writes 4 vertices per glyph with pixels (at most 4 * length) and returns the number of glyphs
+    //written, endX receives the final pen position.
+    //With a dynamic atlas a long text may evict glyphs it placed itself, see takeEvictedCharacters()
+    size_t layoutText(const char32_t* text, size_t length, float x, float y, float z, float scale,
+                      TextVertex* vertices, float* endX = nullptr) const;
+    //UTF-16, surrogate pairs are combined and unpaired surrogates map to the invalid glyph
+    size_t layoutText(const char16_t* text, size_t length, float x, float y, float z, float scale,
+                      TextVertex* vertices, float* endX = nullptr) const;
+    //compressTexture run-length codes the texture in independent row blocks, a loaded font decodes
+    //them in parallel on first use instead of mapping the texture in place
+    void saveToTextureFile(const char* textureFontFileName, bool compressTexture = false) const;
+    const unsigned char* texture() const;  //all pages, one after another, rows of textureRowBytes()
+    const unsigned char* texture(unsigned int page) const;
+    //copies all pages to destination, e.g. a mapped pixel buffer; a compressed texture is decoded
+    //straight into it without being kept in memory
+    void copyTexture(unsigned char* destination) const;
+    //the atlas as GL_COMPRESSED_R11_EAC blocks, all pages one after another, if the font was baked with
+    //TextureFontOptions::eacTexture or loaded from a file that has them, nullptr otherwise. Saved with
+    //the font; texture() stays the exact atlas for the CPU
+    const unsigned char* eacTexture() const;
+    const unsigned char* eacTexture(unsigned int page) const;
+    size_t eacPageBytes() const;
+    //every glyph of eacTexture() against the atlas, the largest rmsError first; empty without eacTexture()
+    std::vector<GlyphCompressionError> eacErrors() const;
+    CharacterImage characterImage(unsigned int unicode) const;  //allocates a copy
+    //no copy, valid until the atlas changes: the next lookup of a dynamic atlas, or publishGlyphs()
+    CharacterImageView characterImageView(unsigned int unicode, unsigned int phase = 0) const;
+    CharacterImageView characterImage(unsigned int unicode, CharacterImageArena& arena) const;
+    float occupancy() const;  //glyph pixels in percent of the atlas
+    //repacks the current glyph sizes with every strategy, with and without sortByHeight;
+    //unsorted MaxRects is quadratic and takes seconds for a full CJK face
+    std::vector<PackingReport> comparePackingStrategies() const;
+    //dynamic atlas and background build: regions written since the last call, at most one per page.
+    //Pages may have been added as well, texture() is reallocated then. Publishes finished glyphs first
+    std::vector<DirtyRect> takeDirtyRects();
+    //dynamic atlas only: code points whose CharacterInfo/TextureCoord became invalid since the last call
+    std::vector<unsigned int> takeEvictedCharacters();
+    GlyphCacheStats glyphCacheStats() const;
+    //changes whenever glyphs were evicted or published, lookups made before may be out of date then
+    unsigned long long atlasGeneration() const;
+    //background build: copies the glyphs the workers finished, in code point order, into the atlas and
+    //returns their number; until then their code points show the invalid glyph. Never blocks
+    size_t publishGlyphs();
+    void waitForBuild();  //blocks until every glyph is rasterized and publishes them
+    bool buildFinished() const;  //every glyph is published, always true without a background build
+    float buildProgress() const;  //glyphs rasterized in percent
 
 private:
     TextureFont& operator=(const TextureFont&) = delete;
@@ -77,17 +306,81 @@ private:
     TextureFont(const TextureFont&) = delete;
     TextureFont(TextureFont &&) = delete;
 
+    struct GlyphCache;
+    struct BackgroundBuild;
+
+    unsigned int resolveCharacter(unsigned int unicode) const;  //slot of unicode, loads it into a dynamic atlas
+    size_t layoutChunk(const char32_t* text, size_t length, unsigned int& previousSlot, float& x, float y, float z, float scale,
+                       TextVertex* vertices) const;
+    void buildKerningHash();
+    unsigned int characterIndex(unsigned int unicode) const;
+    void setCharacterIndex(unsigned int unicode, unsigned int index) const;
+    unsigned int loadCharacter(unsigned int unicode) const;
+    unsigned int insertGlyph(FT_UInt glyph, const GlyphBitmap* variants, bool pinned) const;
+    bool allocateRect(PackRect& rect) const;
+    unsigned int evictSlotFor(PackRect& rect) const;
+    void evictSlot(unsigned int slot) const;
+    void flushGlyphCache() const;
+    void addPage() const;
+    void updateViews() const;
+    void updateGlyphLayout() const;
+    void updateGlyphLayout(unsigned int slot) const;
+    void decodeTexture(unsigned char* destination) const;
+    void startBackgroundBuild(const std::vector<FontFace>& faces, unsigned int h_resolution, unsigned int v_resolution,
+                              const std::vector<FT_UInt>& glyphs, const TextureFontOptions& options);
+    void placeBuiltGlyph(unsigned int slot, const GlyphBitmap* variants);
+    void placeVariants(unsigned int slot, const PackRect& rect, const GlyphBitmap* variants) const;
+
 private:
     FT_Library m_library;
-    FT_Face m_face;
-    unsigned char * m_texture;
+    std::vector<FT_Face> m_faces;  //the fallback chain, while building and for a dynamic atlas
+    mutable const unsigned char * m_texture;
     unsigned int m_textureWidth;   //in pixel
     unsigned int m_textureHeight;  //in pixel
+    mutable unsigned int m_pageNum;
     unsigned int m_characterTotalNum;
     unsigned int m_characterInfoInvalidIndex;
     unsigned int m_pt;  //in point
-    std::vector<CharacterInfo> m_characterInfo;
-    unsigned int * m_characterMap;
+    unsigned int m_distanceFieldSpread;  //in pixel, 0 for coverage
+    bool m_freetypeDistanceField;
+    CharacterSet m_characterSet;
+    //the variants of a glyph are consecutive in m_characterInfo, its slot is the one of phase 0
+    unsigned int m_subpixelPositions;
+    AtlasFormat m_atlasFormat;
+    std::vector<unsigned char> m_coverageTable;  //the bake time gamma, empty for linear coverage
+    FontMetrics m_fontMetrics;
+    mutable const CharacterInfo * m_characterInfo;
+    mutable size_t m_characterInfoNum;
+    //two-level code point map: m_characterBlocks[m_characterBlockIndex[unicode >> 8] * 256 + (unicode & 0xff)],
+    //block 0 is shared by every 256 code point block without a glyph
+    mutable const unsigned int * m_characterBlockIndex;
+    mutable const unsigned int * m_characterBlocks;
+    mutable size_t m_characterBlockNum;
+    //sorted by left, then right; a dynamic atlas keys them by glyph index instead of slot, as slots are reused
+    const KerningPair * m_kerningPairs;
+    size_t m_kerningPairNum;
+    unsigned int m_kerningHashBits;
+    const unsigned char * m_compressedTexture;  //in the mapped file, until texture() decodes it
+    size_t m_compressedTextureSize;
+    const unsigned char * m_eacTexture;  //nullptr without EAC blocks
+
+    //the views above point either into these, for built fonts, or into the mapped file
+    mutable std::vector<unsigned char> m_textureStorage;
+    mutable std::vector<CharacterInfo> m_characterInfoStorage;
+    mutable std::vector<unsigned int> m_characterBlockIndexStorage;
+    mutable std::vector<unsigned int> m_characterBlocksStorage;
+    std::vector<KerningPair> m_kerningPairStorage;
+    std::vector<unsigned char> m_eacTextureStorage;
+    std::vector<KerningPair> m_kerningHash;  //open addressing over m_kerningPairs, left NO_SLOT marks empty entries
+    std::vector<uint64_t> m_kerningFilter;   //one bit per hash of the pairs, 8 bits per entry of m_kerningHash
+    mutable GlyphLayoutTable m_glyphLayout;  //one row per slot of m_characterInfo
+    void * m_mapping;
+    size_t m_mappingSize;
+
+    mutable unsigned long long m_atlasGeneration;
+
+    std::unique_ptr<GlyphCache> m_glyphCache;  //dynamic atlas only, filled in by the const lookups
+    std::unique_ptr<BackgroundBuild> m_backgroundBuild;  //until every glyph is published
 };
 
 #endif // TEXTUREFONT_H
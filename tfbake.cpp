@@ -0,0 +1,444 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "texturefont.h"
+
+//bakes every combination of font file, point size and resolution into a .tf file, one
+//TextureFont per job and several jobs at once, so a whole font matrix is one run
+
+struct BakeJob
+{
+    FontFace face;
+    unsigned int pt;
+    unsigned int h_resolution;
+    unsigned int v_resolution;
+    std::string outputFileName;
+};
+
+static void printUsage()
+{
+    fprintf(stderr,
+            "usage: tfbake [options] <font file>[:face index]...\n"
+            "  -s, --sizes <pt,...>          point sizes, default 16\n"
+            "  -r, --dpi <dpi[xdpi],...>     resolutions, horizontal x vertical, default 96\n"
+            "  -o, --output <directory>      default the current directory\n"
+            "  -j, --jobs <n>                fonts baked at once, default the hardware threads\n"
+            "  -t, --threads <n>             rasterizing threads per font, default 1\n"
+            "      --sdf [spread]            signed distance fields, spread in pixel, default 8\n"
+            "      --freetype-sdf            render the distance fields with FreeType's sdf module\n"
+            "      --compress                run-length compress the texture\n"
+            "      --max-texture-size <n>    split the atlas into pages no larger than this\n"
+            "      --packing <strategy>      shelf, skyline or maxrects, default shelf\n"
+            "      --sort                    pack the tallest glyphs first\n"
+            "      --compare-packing         also print the atlas every packing strategy would give\n"
+            "      --subpixel <n>            1..4 horizontally shifted variants of every glyph, default 1\n"
+            "      --format <format>         coverage8, coverage4 or lcd, default coverage8\n"
+            "      --gamma <gamma>           coverage gamma 0.25..4 applied while baking, default 1\n"
+            "      --eac                     also store the coverage8 atlas as EAC R11 blocks for the GPU\n"
+            "      --eac-report              write the EAC error of every glyph to <output file>.eac.csv\n"
+            "      --charset <ranges>        bake only these code points, e.g. U+0020-007E,U+4E00-9FA5\n"
+            "      --charset-file <file>     bake only the characters of a UTF-8 text file\n"
+            "      --strings <file>          bake only the characters of the quoted strings of a string table\n"
+            "      --fallback <file>[:index] for the code points the font lacks, may be repeated, tried in order\n"
+            "The subset options may be repeated and combined, the atlas holds their union\n"
+            "A face index selects a face of a collection (.ttc, .otc), 0 by default\n"
+            "Writes <output>/<font name>[-<face index>]-<pt>pt-<dpi>dpi.tf for every combination\n");
+}
+
+static bool parseUnsignedList(const char* text, std::vector<unsigned int>& values)
+{
+    values.clear();
+    while(*text)
+    {
+        char* end;
+        unsigned long value = strtoul(text, &end, 10);
+        if(end == text || value == 0 || (*end != ',' && *end != '\0'))
+        {
+            return false;
+        }
+        values.push_back(value);
+        text = *end ? end + 1 : end;
+    }
+    return !values.empty();
+}
+
+//"96" or "96x72"
+static bool parseResolutionList(const char* text, std::vector<std::pair<unsigned int, unsigned int> >& resolutions)
+{
+    resolutions.clear();
+    while(*text)
+    {
+        char* end;
+        unsigned long h = strtoul(text, &end, 10);
+        unsigned long v = h;
+        if(end != text && *end == 'x')
+        {
+            const char* vertical = end + 1;
+            v = strtoul(vertical, &end, 10);
+            if(end == vertical)
+            {
+                return false;
+            }
+        }
+        if(end == text || h == 0 || v == 0 || (*end != ',' && *end != '\0'))
+        {
+            return false;
+        }
+        resolutions.push_back(std::make_pair((unsigned int)h, (unsigned int)v));
+        text = *end ? end + 1 : end;
+    }
+    return !resolutions.empty();
+}
+
+//"font.ttc:2" is face 2 of font.ttc
+static FontFace parseFontFace(const char* arg)
+{
+    FontFace face{arg, 0};
+    size_t colon = face.fileName.find_last_of(':');
+    if(colon != std::string::npos && colon + 1 < face.fileName.size()
+       && face.fileName.find_first_not_of("0123456789", colon + 1) == std::string::npos)
+    {
+        face.faceIndex = strtoul(face.fileName.c_str() + colon + 1, nullptr, 10);
+        face.fileName.erase(colon);
+    }
+    return face;
+}
+
+static std::string outputFileName(const std::string& directory, const FontFace& face, unsigned int pt, unsigned int h_resolution, unsigned int v_resolution)
+{
+    std::string name(face.fileName);
+    size_t slash = name.find_last_of('/');
+    if(slash != std::string::npos)
+    {
+        name = name.substr(slash + 1);
+    }
+    size_t dot = name.find_last_of('.');
+    if(dot != std::string::npos && dot != 0)
+    {
+        name = name.substr(0, dot);
+    }
+    if(face.faceIndex != 0)
+    {
+        name += "-" + std::to_string(face.faceIndex);
+    }
+    name += "-" + std::to_string(pt) + "pt-" + std::to_string(h_resolution);
+    if(v_resolution != h_resolution)
+    {
+        name += "x" + std::to_string(v_resolution);
+    }
+    return directory + "/" + name + "dpi.tf";
+}
+
+//worst glyphs first, the errors in 1/255 of full coverage
+static bool writeEacReport(const std::string& fileName, const std::vector<GlyphCompressionError>& errors)
+{
+    FILE* file = fopen(fileName.c_str(), "w");
+    if(!file)
+    {
+        return false;
+    }
+    fprintf(file, "code point,phase,max error,rms error\n");
+    for(auto iter = errors.begin(); iter != errors.end(); iter++)
+    {
+        fprintf(file, "U+%04X,%u,%u,%.2f\n", iter->unicode, iter->phase, iter->maxError, iter->rmsError);
+    }
+    return fclose(file) == 0;
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<FontFace> fonts;
+    std::vector<unsigned int> sizes(1, 16);
+    std::vector<std::pair<unsigned int, unsigned int> > resolutions(1, std::make_pair(96u, 96u));
+    std::string outputDirectory(".");
+    unsigned int jobNum = std::max(1u, std::thread::hardware_concurrency());
+    bool compressTexture = false;
+    bool eacReport = false;
+    bool comparePacking = false;
+    TextureFontOptions options;
+    for(int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        std::vector<unsigned int> values;
+        if((!strcmp(arg, "-s") || !strcmp(arg, "--sizes")) && hasValue)
+        {
+            if(!parseUnsignedList(argv[++i], sizes))
+            {
+                fprintf(stderr, "[Error] invalid point sizes %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if((!strcmp(arg, "-r") || !strcmp(arg, "--dpi")) && hasValue)
+        {
+            if(!parseResolutionList(argv[++i], resolutions))
+            {
+                fprintf(stderr, "[Error] invalid resolutions %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if((!strcmp(arg, "-o") || !strcmp(arg, "--output")) && hasValue)
+        {
+            outputDirectory = argv[++i];
+        }
+        else if((!strcmp(arg, "-j") || !strcmp(arg, "--jobs")) && hasValue && parseUnsignedList(argv[i + 1], values) && values.size() == 1)
+        {
+            jobNum = values[0];
+            i++;
+        }
+        else if((!strcmp(arg, "-t") || !strcmp(arg, "--threads")) && hasValue && parseUnsignedList(argv[i + 1], values) && values.size() == 1)
+        {
+            options.threadNum = values[0];
+            i++;
+        }
+        else if(!strcmp(arg, "--sdf"))
+        {
+            options.signedDistanceField = true;
+            if(hasValue && parseUnsignedList(argv[i + 1], values) && values.size() == 1)
+            {
+                options.distanceFieldSpread = values[0];
+                i++;
+            }
+        }
+        else if(!strcmp(arg, "--freetype-sdf"))
+        {
+            options.freetypeDistanceField = true;
+        }
+        else if(!strcmp(arg, "--compress"))
+        {
+            compressTexture = true;
+        }
+        else if(!strcmp(arg, "--max-texture-size") && hasValue && parseUnsignedList(argv[i + 1], values) && values.size() == 1)
+        {
+            options.maxTextureSize = values[0];
+            i++;
+        }
+        else if(!strcmp(arg, "--packing") && hasValue)
+        {
+            const char* strategy = argv[++i];
+            if(!strcmp(strategy, "shelf"))
+            {
+                options.packingStrategy = PackingStrategy::Shelf;
+            }
+            else if(!strcmp(strategy, "skyline"))
+            {
+                options.packingStrategy = PackingStrategy::Skyline;
+            }
+            else if(!strcmp(strategy, "maxrects"))
+            {
+                options.packingStrategy = PackingStrategy::MaxRects;
+            }
+            else
+            {
+                fprintf(stderr, "[Error] unknown packing strategy %s\n", strategy);
+                return 1;
+            }
+        }
+        else if(!strcmp(arg, "--eac"))
+        {
+            options.eacTexture = true;
+        }
+        else if(!strcmp(arg, "--eac-report"))
+        {
+            options.eacTexture = true;
+            eacReport = true;
+        }
+        else if(!strcmp(arg, "--compare-packing"))
+        {
+            comparePacking = true;
+        }
+        else if(!strcmp(arg, "--sort"))
+        {
+            options.sortByHeight = true;
+        }
+        else if(!strcmp(arg, "--subpixel") && hasValue)
+        {
+            if(!parseUnsignedList(argv[++i], values) || values.size() != 1 || values[0] > 4)
+            {
+                fprintf(stderr, "[Error] invalid subpixel positions %s\n", argv[i]);
+                return 1;
+            }
+            options.subpixelPositions = values[0];
+        }
+        else if(!strcmp(arg, "--format") && hasValue)
+        {
+            const char* format = argv[++i];
+            if(!strcmp(format, "coverage8"))
+            {
+                options.atlasFormat = AtlasFormat::Coverage8;
+            }
+            else if(!strcmp(format, "coverage4"))
+            {
+                options.atlasFormat = AtlasFormat::Coverage4;
+            }
+            else if(!strcmp(format, "lcd"))
+            {
+                options.atlasFormat = AtlasFormat::LCD;
+            }
+            else
+            {
+                fprintf(stderr, "[Error] unknown atlas format %s\n", format);
+                return 1;
+            }
+        }
+        else if(!strcmp(arg, "--gamma") && hasValue)
+        {
+            char* end;
+            options.coverageGamma = strtof(argv[++i], &end);
+            if(*end != '\0' || !(options.coverageGamma >= 0.25f && options.coverageGamma <= 4.0f))
+            {
+                fprintf(stderr, "[Error] invalid coverage gamma %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if(!strcmp(arg, "--charset") && hasValue)
+        {
+            if(!options.characterSet.addRanges(argv[++i]))
+            {
+                fprintf(stderr, "[Error] invalid code point ranges %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if(!strcmp(arg, "--charset-file") && hasValue)
+        {
+            options.characterSet.addCharacterFile(argv[++i]);
+        }
+        else if(!strcmp(arg, "--strings") && hasValue)
+        {
+            options.characterSet.addStringTable(argv[++i]);
+        }
+        else if(!strcmp(arg, "--fallback") && hasValue)
+        {
+            options.fallbackFaces.push_back(parseFontFace(argv[++i]));
+        }
+        else if(arg[0] != '-')
+        {
+            fonts.push_back(parseFontFace(arg));
+        }
+        else
+        {
+            printUsage();
+            return 1;
+        }
+    }
+    if(fonts.empty())
+    {
+        printUsage();
+        return 1;
+    }
+    if(options.eacTexture && options.atlasFormat != AtlasFormat::Coverage8)
+    {
+        fprintf(stderr, "[Error] EAC textures hold coverage8 atlases only\n");
+        return 1;
+    }
+    //TextureFont exits on a font it cannot open, better before any job has started
+    std::vector<FontFace> faces(fonts);
+    faces.insert(faces.end(), options.fallbackFaces.begin(), options.fallbackFaces.end());
+    for(auto iter = faces.begin(); iter != faces.end(); iter++)
+    {
+        if(access(iter->fileName.c_str(), R_OK) != 0)
+        {
+            fprintf(stderr, "[Error] cannot read %s\n", iter->fileName.c_str());
+            return 1;
+        }
+    }
+    if(access(outputDirectory.c_str(), W_OK) != 0)
+    {
+        fprintf(stderr, "[Error] cannot write to %s\n", outputDirectory.c_str());
+        return 1;
+    }
+
+    if(!options.characterSet.empty())
+    {
+        printf("subset of %zu code points in %zu ranges\n", options.characterSet.size(), options.characterSet.ranges().size());
+    }
+
+    std::vector<BakeJob> jobs;
+    for(auto font = fonts.begin(); font != fonts.end(); font++)
+    {
+        for(auto pt = sizes.begin(); pt != sizes.end(); pt++)
+        {
+            for(auto resolution = resolutions.begin(); resolution != resolutions.end(); resolution++)
+            {
+                jobs.push_back(BakeJob{*font, *pt, resolution->first, resolution->second,
+                                       outputFileName(outputDirectory, *font, *pt, resolution->first, resolution->second)});
+            }
+        }
+    }
+
+    //every job owns its TextureFont and with it its FreeType library, the workers share nothing else
+    auto start = std::chrono::steady_clock::now();
+    std::atomic<size_t> nextJob(0);
+    std::atomic<bool> reportFailed(false);  //the .tf files exit on failure in saveToTextureFile()
+    std::mutex printMutex;
+    auto work = [&]() {
+        for(size_t i = nextJob++; i < jobs.size(); i = nextJob++)
+        {
+            const BakeJob& job = jobs[i];
+            auto jobStart = std::chrono::steady_clock::now();
+            TextureFontOptions jobOptions(options);
+            jobOptions.faceIndex = job.face.faceIndex;
+            TextureFont font(job.face.fileName.c_str(), job.pt, job.h_resolution, job.v_resolution, jobOptions);
+            font.saveToTextureFile(job.outputFileName.c_str(), compressTexture);
+            std::vector<GlyphCompressionError> errors = font.eacErrors();
+            bool reportWritten = !eacReport || writeEacReport(job.outputFileName + ".eac.csv", errors);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - jobStart).count();
+            std::lock_guard<std::mutex> lock(printMutex);
+            printf("[%zu/%zu] %s: %u glyphs, %u pages of %ux%u %s (%zu KiB), %.1f%% occupied, %.2f s\n", i + 1, jobs.size(), job.outputFileName.c_str(),
+                   font.characterTotalNum(), font.pageNum(), font.textureWidth(), font.textureHeight(), atlasFormatName(font.atlasFormat()),
+                   font.textureRowBytes() * font.textureHeight() * font.pageNum() / 1024, font.occupancy(), seconds);
+            if(!errors.empty())
+            {
+                double rmsSum = 0.0;
+                unsigned int maxError = 0;
+                for(auto iter = errors.begin(); iter != errors.end(); iter++)
+                {
+                    rmsSum += iter->rmsError;
+                    maxError = std::max(maxError, iter->maxError);
+                }
+                printf("    EAC R11 %zu KiB, rms error mean %.2f worst %.2f (U+%04X), max error %u of 255\n", font.eacPageBytes() * font.pageNum() / 1024,
+                       rmsSum / errors.size(), errors[0].rmsError, errors[0].unicode, maxError);
+            }
+            if(comparePacking)
+            {
+                std::vector<PackingReport> reports = font.comparePackingStrategies();
+                for(auto iter = reports.begin(); iter != reports.end(); iter++)
+                {
+                    printf("    %-8s %-6s %u pages of %ux%u, %.1f%% occupied\n", packingStrategyName(iter->strategy), iter->sortByHeight ? "sorted" : "",
+                           iter->pageNum, iter->textureWidth, iter->textureHeight, iter->occupancy);
+                }
+            }
+            if(!reportWritten)
+            {
+                fprintf(stderr, "[Error] cannot write %s.eac.csv\n", job.outputFileName.c_str());
+                reportFailed = true;
+            }
+            fflush(stdout);
+        }
+    };
+    std::vector<std::thread> workers;
+    for(unsigned int t = 1; t < jobNum && t < jobs.size(); t++)
+    {
+        workers.emplace_back(work);
+    }
+    work();
+    for(auto& worker : workers)
+    {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    //of the whole process, so with -j 1 the largest single job plus the baker itself
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("baked %zu atlases in %.2f s, peak RSS %.1f MiB\n", jobs.size(), seconds, usage.ru_maxrss / 1024.0);
+    return reportFailed ? 1 : 0;
+}
@@ -0,0 +1,33 @@
+#-------------------------------------------------
+#
+# Offline atlas baker, writes .tf files for every combination
+# of font, point size and resolution; needs no Qt
+#
+#-------------------------------------------------
+
+CONFIG += c++11 thread console
+CONFIG -= qt app_bundle
+
+TARGET = tfbake
+TEMPLATE = app
+
+INCLUDEPATH += \
+    /usr/include/freetype2
+
+LIBS += \
+    -lfreetype
+
+SOURCES += \
+    tfbake.cpp \
+    texturefont.cpp \
+    eaccodec.cpp \
+    atlaspacker.cpp \
+    characterset.cpp \
+    textlayout.cpp
+
+HEADERS += \
+    texturefont.h \
+    eaccodec.h \
+    atlaspacker.h \
+    characterset.h \
+    textlayout.h
@@ -8,6 +8,7 @@ Widget::Widget(QWidget *parent) :
 {
     ui->setupUi(this);
     oglwidget = new OGLWidget(this);
+    oglwidget->setStatsOverlayVisible(true);
     QHBoxLayout * layout = new QHBoxLayout;
     layout->addWidget(oglwidget);
     layout->setMargin(0);